@@ -196,8 +196,14 @@ off_t inode_read_at(struct inode *inode, void *buffer_, off_t size, off_t offset
             break;
 
         if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
-            /* Read full sector directly into caller's buffer. */
-            disk_read(filesys_disk, sector_idx, buffer + bytes_read);
+            /* Read the run of full sectors directly into caller's
+             * buffer with one command.  File data is contiguous on
+             * disk, so the run ends only at the end of the request. */
+            off_t full = (size < inode_left ? size : inode_left) / DISK_SECTOR_SIZE;
+            size_t cnt = full < DISK_MAX_SECTORS ? full : DISK_MAX_SECTORS;
+
+            disk_read_multiple(filesys_disk, sector_idx, cnt, buffer + bytes_read);
+            chunk_size = cnt * DISK_SECTOR_SIZE;
         } else {
             /* Read sector into bounce buffer, then partially copy
              * into caller's buffer. */
@@ -250,8 +256,13 @@ off_t inode_write_at(struct inode *inode, const void *buffer_, off_t size,
             break;
 
         if (sector_ofs == 0 && chunk_size == DISK_SECTOR_SIZE) {
-            /* Write full sector directly to disk. */
-            disk_write(filesys_disk, sector_idx, buffer + bytes_written);
+            /* Write the run of full sectors directly from caller's
+             * buffer with one command, as inode_read_at() reads. */
+            off_t full = (size < inode_left ? size : inode_left) / DISK_SECTOR_SIZE;
+            size_t cnt = full < DISK_MAX_SECTORS ? full : DISK_MAX_SECTORS;
+
+            disk_write_multiple(filesys_disk, sector_idx, cnt, buffer + bytes_written);
+            chunk_size = cnt * DISK_SECTOR_SIZE;
         } else {
             /* We need a bounce buffer. */
             if (bounce == NULL) {
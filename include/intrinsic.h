@@ -36,12 +36,36 @@ __attribute__((always_inline)) static __inline uint64_t read_eflags(void) {
     return rflags;
 }
 
+/* Executes CPUID for LEAF and stores EAX, EBX, ECX and EDX in REGS. */
+__attribute__((always_inline)) static __inline void cpuid(uint32_t leaf, uint32_t regs[4]) {
+    __asm __volatile("cpuid"
+                     : "=a"(regs[0]), "=b"(regs[1]), "=c"(regs[2]), "=d"(regs[3])
+                     : "a"(leaf), "c"(0));
+}
+
+/* Reads the time-stamp counter. */
+__attribute__((always_inline)) static __inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    __asm __volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
 __attribute__((always_inline)) static __inline uint64_t rcr3(void) {
     uint64_t val;
     __asm __volatile("movq %%cr3,%0" : "=r"(val));
     return val;
 }
 
+__attribute__((always_inline)) static __inline uint64_t rcr4(void) {
+    uint64_t val;
+    __asm __volatile("movq %%cr4,%0" : "=r"(val));
+    return val;
+}
+
+__attribute__((always_inline)) static __inline void lcr4(uint64_t val) {
+    __asm __volatile("movq %0, %%cr4" : : "r"(val) : "memory");
+}
+
 __attribute__((always_inline)) static __inline uint64_t rrax(void) {
     uint64_t val;
     __asm __volatile("movq %%rax,%0" : "=r"(val));
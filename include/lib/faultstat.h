@@ -0,0 +1,29 @@
+#ifndef __LIB_FAULTSTAT_H
+#define __LIB_FAULTSTAT_H
+
+/* Kinds of page faults resolved by the kernel. */
+enum fault_kind {
+    FAULT_STACK, /* Stack growth. */
+    FAULT_EXEC,  /* First touch of an executable page. */
+    FAULT_FILE,  /* Memory-mapped file page read in. */
+    FAULT_ZERO,  /* First touch of an anonymous page. */
+    FAULT_SWAP,  /* Anonymous page brought back from swap. */
+    FAULT_COW,   /* Write to a copy-on-write page. */
+    FAULT_KIND_CNT
+};
+
+/* Latency histogram buckets, in TSC cycles.  Bucket 0 counts faults
+ * under 2^FAULT_HIST_SHIFT cycles, bucket I the ones in
+ * [2^(FAULT_HIST_SHIFT+I-1), 2^(FAULT_HIST_SHIFT+I)), and the last
+ * bucket everything slower. */
+#define FAULT_HIST_BUCKETS 16
+#define FAULT_HIST_SHIFT 10
+
+/* Page fault counters, as returned by fault_stats(). */
+struct fault_stats {
+    unsigned long long count[FAULT_KIND_CNT];  /* Faults handled. */
+    unsigned long long cycles[FAULT_KIND_CNT]; /* Total cycles spent. */
+    unsigned long long hist[FAULT_KIND_CNT][FAULT_HIST_BUCKETS];
+};
+
+#endif /* lib/faultstat.h */
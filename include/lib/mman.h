@@ -0,0 +1,25 @@
+#ifndef __LIB_MMAN_H
+#define __LIB_MMAN_H
+
+/* Bits of mmap()'s WRITABLE argument; plain true and false still work. */
+#define MAP_WRITE 0x1    /* Pages may be written. */
+#define MAP_POPULATE 0x2 /* Fault in the whole mapping before returning. */
+#define MAP_ANON 0x4     /* Zero-filled memory instead of a file; FD is -1. */
+#define MAP_SHARED 0x8   /* Share frames and writes with other MAP_SHARED mappings. */
+
+/* Advice values for madvise(). */
+#define MADV_NORMAL 0     /* No special treatment. */
+#define MADV_RANDOM 1     /* Expect page references in random order. */
+#define MADV_SEQUENTIAL 2 /* Expect page references in sequential order. */
+#define MADV_WILLNEED 3   /* Will need these pages soon. */
+#define MADV_DONTNEED 4   /* Don't need these pages. */
+
+/* Memory use of a process, in pages, as returned by mem_usage(). */
+struct mem_usage {
+    unsigned long long rss;       /* Pages currently resident. */
+    unsigned long long rss_limit; /* Resident-set limit, 0 if none. */
+    unsigned long long wss;       /* Pages referenced in the last sample. */
+    unsigned long long huge_faults; /* 2 MB pages mapped by faults so far. */
+};
+
+#endif /* lib/mman.h */
@@ -0,0 +1,15 @@
+#ifndef __LIB_SPAWN_H
+#define __LIB_SPAWN_H
+
+/* Limits on the arguments of spawn(). */
+#define SPAWN_ARGV_MAX 64 /* Command-line arguments, with argv[0]. */
+#define SPAWN_FD_MAX 16   /* Descriptors handed to the child. */
+
+/* A descriptor handed to the child by spawn(): the parent's FD becomes
+   the child's CHILD_FD.  A list of actions ends with an FD of -1. */
+struct spawn_fd_action {
+    int fd;       /* Descriptor in the parent. */
+    int child_fd; /* Number it gets in the child. */
+};
+
+#endif /* lib/spawn.h */
@@ -36,6 +36,18 @@ enum {
 
     SYS_MOUNT,
     SYS_UMOUNT,
+
+    /* Virtual memory extensions. */
+    SYS_MADVISE,     /* Give advice about use of memory. */
+    SYS_FAULT_STATS, /* Read page fault counters. */
+    SYS_RSS_LIMIT,   /* Set the resident-set limit. */
+    SYS_MEM_USAGE,   /* Read resident and working-set sizes. */
+    SYS_SBRK,        /* Move the program break. */
+    SYS_SPAWN,       /* Start a new process from an executable. */
+    SYS_SHM_CREATE,  /* Create a shared memory segment. */
+    SYS_SHM_ATTACH,  /* Map a shared memory segment. */
+    SYS_SHM_DETACH,  /* Unmap a shared memory segment. */
+    SYS_MSYNC,       /* Write back dirty pages of file mappings. */
 };
 
 #endif /* lib/syscall-nr.h */
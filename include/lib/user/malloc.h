@@ -0,0 +1,12 @@
+#ifndef __LIB_USER_MALLOC_H
+#define __LIB_USER_MALLOC_H
+
+#include <stddef.h>
+
+/* Dynamic memory for user programs; see lib/user/malloc.c. */
+void *malloc(size_t size);
+void *calloc(size_t cnt, size_t size);
+void *realloc(void *ptr, size_t size);
+void free(void *ptr);
+
+#endif /* lib/user/malloc.h */
@@ -2,8 +2,12 @@
 #define __LIB_USER_SYSCALL_H
 
 #include <debug.h>
+#include <faultstat.h>
+#include <mman.h>
+#include <spawn.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -25,6 +29,7 @@ void halt(void) NO_RETURN;
 void exit(int status) NO_RETURN;
 pid_t fork(const char *thread_name);
 int exec(const char *file);
+pid_t spawn(const char *file, char *const argv[], const struct spawn_fd_action *actions);
 int wait(pid_t);
 bool create(const char *file, unsigned initial_size);
 bool remove(const char *file);
@@ -41,6 +46,16 @@ int dup2(int oldfd, int newfd);
 /* Project 3 and optionally project 4. */
 void *mmap(void *addr, size_t length, int writable, int fd, off_t offset);
 void munmap(void *addr);
+int madvise(void *addr, size_t length, int advice);
+int msync(void *addr, size_t length);
+int fault_stats(struct fault_stats *stats, bool global);
+int rss_limit(size_t pages);
+int mem_usage(struct mem_usage *usage);
+void *sbrk(intptr_t increment);
+int brk(void *addr);
+int shm_create(size_t size);
+void *shm_attach(int id, void *addr, int flags);
+int shm_detach(void *addr);
 
 /* Project 4 only. */
 bool chdir(const char *dir);
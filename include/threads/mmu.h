@@ -3,22 +3,80 @@
 
 #include "threads/pte.h"
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 typedef bool pte_for_each_func(uint64_t *pte, void *va, void *aux);
 
+/* Control register bits. */
+#define CR4_PGE (1 << 7)          /* Global pages. */
+#define CR4_PCIDE (1 << 17)       /* Process-context identifiers. */
+#define CR3_PCID_MASK 0xfffUL     /* PCID of the active address space. */
+#define CR3_NOFLUSH (1UL << 63)   /* Keep the TLB entries of the PCID. */
+
+/* True once address spaces are tagged with PCIDs. */
+extern bool pcid_enabled;
+
+void pml4_enable_pcid(void);
+
+/* Batch of TLB invalidations for one address space.  Between
+ * mmu_gather_begin and mmu_gather_end, PTE changes that the current
+ * thread makes in PML4 queue their invalidation instead of issuing it,
+ * and pages passed to mmu_gather_free_page are freed only after the
+ * flush, so no stale TLB entry can reach them.  Past MMU_GATHER_MAX
+ * pages, the flush reloads CR3 instead of invalidating page by page. */
+#define MMU_GATHER_MAX 32        /* Most pages invalidated one by one. */
+#define MMU_GATHER_FREE_MAX 512  /* Most pages held for freeing. */
+
+struct mmu_gather {
+    uint64_t *pml4;               /* Address space being changed. */
+    size_t cnt;                   /* Invalidations queued. */
+    uint64_t va[MMU_GATHER_MAX];  /* Their addresses, if cnt fits. */
+    void *free_list;              /* Pages to free, linked by first word. */
+    size_t free_cnt;              /* Pages on free_list. */
+};
+
+void mmu_gather_begin(struct mmu_gather *, uint64_t *pml4);
+void mmu_gather_flush(struct mmu_gather *);
+void mmu_gather_end(struct mmu_gather *);
+void mmu_gather_free_page(void *page);
+
 uint64_t *pml4e_walk(uint64_t *pml4, const uint64_t va, int create);
 uint64_t *pml4_create(void);
 bool pml4_for_each(uint64_t *, pte_for_each_func *, void *);
 void pml4_destroy(uint64_t *pml4);
+void pml4_reap(uint64_t *pml4);
+void pml4_reap_tables(uint64_t *pml4);
+void pml4_reaper_init(void);
 void pml4_activate(uint64_t *pml4);
+bool pml4_is_active(uint64_t *pml4);
 void *pml4_get_page(uint64_t *pml4, const void *upage);
 bool pml4_set_page(uint64_t *pml4, void *upage, void *kpage, bool rw);
+uint64_t *pml4_map_page(uint64_t *pml4, void *upage, void *kpage, bool rw);
 void pml4_clear_page(uint64_t *pml4, void *upage);
 bool pml4_is_dirty(uint64_t *pml4, const void *upage);
 void pml4_set_dirty(uint64_t *pml4, const void *upage, bool dirty);
 bool pml4_is_accessed(uint64_t *pml4, const void *upage);
 void pml4_set_accessed(uint64_t *pml4, const void *upage, bool accessed);
+bool pml4_set_huge_page(uint64_t *pml4, void *upage, void *kpage, bool rw);
+bool pml4_is_huge(uint64_t *pml4, const void *upage);
+bool pml4_split_huge(uint64_t *pml4, const void *upage);
+void pml4_free_tables(uint64_t *pml4, void *start, void *end);
+bool pml4_map_kernel(uint64_t *pml4, uint64_t va, uint64_t pa, uint64_t size, uint64_t perm);
+
+/* Accessors for a page table entry already looked up, for callers that
+ * keep the entry of a page.  PTE may be a null pointer for the tests. */
+void pte_clear(uint64_t *pml4, uint64_t *pte, const void *upage);
+void pte_set_dirty(uint64_t *pml4, uint64_t *pte, const void *vpage, bool dirty);
+void pte_set_accessed(uint64_t *pml4, uint64_t *pte, const void *vpage, bool accessed);
+
+static inline bool pte_is_dirty(const uint64_t *pte) {
+    return pte != NULL && (*pte & PTE_D) != 0;
+}
+
+static inline bool pte_is_accessed(const uint64_t *pte) {
+    return pte != NULL && (*pte & PTE_A) != 0;
+}
 
 #define is_writable(pte) (*(pte) & PTE_W)
 #define is_user_pte(pte) (*(pte) & PTE_U)
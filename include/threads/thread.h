@@ -115,11 +115,19 @@ struct thread {
 #ifdef USERPROG
     /* Owned by userprog/process.c. */
     uint64_t *pml4; /* Page map level 4 */
+    struct mmu_gather *tlb; /* TLB batch in progress, or NULL */
 #endif
 #ifdef VM
     /* Table for whole virtual memory owned by thread. */
     struct supplemental_page_table spt;
     void *rsp ;
+    struct fault_stats *fault_stats; /* Page fault counters, or NULL */
+    size_t rss;       /* Resident pages; see vm/rss.c */
+    size_t rss_limit; /* Resident-set limit in pages, 0 if none */
+    size_t wss;       /* Pages accessed in the last working-set sample */
+    size_t wss_scan;  /* Count of the sample in progress */
+    size_t huge_faults; /* 2 MB pages mapped by its faults */
+    struct thrash_hold *thrash_hold; /* Set while suspended by loadctl */
     
 #endif
 
@@ -2,6 +2,7 @@
 #define USERPROG_PROCESS_H
 
 #include "threads/thread.h"
+#include <spawn.h>
 
 #define WORD_SIZE 8
 
@@ -21,12 +22,27 @@ struct load_aux {
     size_t page_read_bytes;
     size_t page_zero_bytes;
     size_t length;
+    bool shared; /* Page of a MAP_SHARED mapping; see vm/share.c */
+};
+
+/* Arguments of spawn(), copied out of the parent into one page so the
+ * child can read them from its own address space. */
+struct spawn_args {
+    struct thread *parent;                         /* Spawning process. */
+    char *path;                                    /* Executable to load. */
+    uint64_t argc;                                 /* Entries in ARGV. */
+    char *argv[SPAWN_ARGV_MAX];                    /* Command-line arguments. */
+    size_t action_cnt;                             /* Entries in ACTIONS. */
+    struct spawn_fd_action actions[SPAWN_FD_MAX];  /* Descriptors to hand over. */
+    size_t used;                                   /* Bytes of STRINGS in use. */
+    char strings[];                                /* PATH and ARGV strings. */
 };
 
 bool lazy_load_segment(struct page *page, void *aux);
 
 tid_t process_create_initd(const char *file_name);
 tid_t process_fork(const char *name, struct intr_frame *if_);
+tid_t process_spawn(struct spawn_args *args);
 int process_exec(void *f_name);
 int process_wait(tid_t);
 void process_exit(void);
@@ -2,12 +2,32 @@
 #define VM_ANON_H
 #include "vm/vm.h"
 struct page;
+struct zswap_entry;
+struct load_aux;
+struct supplemental_page_table;
 enum vm_type;
 
+/* Number of virtually adjacent pages written to contiguous swap slots
+ * by one eviction, and number of slots read on one swap-in fault. */
+#define SWAP_CLUSTER_PAGES 8
+#define SWAP_READAHEAD_PAGES 8
+
 struct anon_page {
+    struct zswap_entry *zswap; /* Compressed copy while swapped out, or NULL */
+    struct load_aux *origin;   /* Executable segment loaded from, or NULL */
 };
 
+/* Pages brought back in from swap and pushed out to it, including
+ * readahead and the compressed pool, since boot. */
+extern long long anon_swap_ins;
+extern long long anon_swap_outs;
+
 void vm_anon_init(void);
 bool anon_initializer(struct page *page, enum vm_type type, void *kva);
+size_t anon_swap_out_cluster(struct page **pages, size_t cnt);
+size_t anon_swap_write(const void *kva);
+void anon_swap_read(size_t slot_no, void *kva);
+void anon_swap_free(size_t slot_no);
+void anon_swap_release(struct supplemental_page_table *spt);
 
 #endif
@@ -0,0 +1,20 @@
+#ifndef VM_FAULTSTAT_H
+#define VM_FAULTSTAT_H
+#include <faultstat.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+struct thread;
+
+/* Print fault statistics at process exit and power off.
+ * Controlled by kernel command-line option "-fault-stats". */
+extern bool faultstat_verbose;
+
+void faultstat_init(void);
+void faultstat_record(enum fault_kind kind, uint64_t cycles);
+unsigned long long faultstat_global_count(enum fault_kind kind);
+int faultstat_query(struct fault_stats *buf, bool global);
+void faultstat_exit(struct thread *t);
+void faultstat_print_stats(void);
+
+#endif /* vm/faultstat.h */
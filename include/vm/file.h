@@ -4,6 +4,7 @@
 #include "vm/vm.h"
 
 struct page;
+struct supplemental_page_table;
 enum vm_type;
 
 struct file_page {
@@ -14,4 +15,9 @@ bool file_backed_initializer(struct page *page, enum vm_type type, void *kva);
 void *do_mmap(void *addr, size_t length, int writable,
               struct file *file, off_t offset);
 void do_munmap(void *va);
+int do_msync(void *addr, size_t length);
+void file_writeback_exit(struct supplemental_page_table *spt);
+void file_writeback_flush(void);
+bool file_writeback_reclaim(void);
+void file_print_stats(void);
 #endif
@@ -0,0 +1,25 @@
+#ifndef VM_HEAP_H
+#define VM_HEAP_H
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "threads/vaddr.h"
+
+struct supplemental_page_table;
+struct shm_segment;
+
+/* Mappings placed by the kernel (mmap with a null ADDR) grow down from
+ * here, leaving room for the stack above. */
+#define ANON_MAP_TOP ((uint8_t *)USER_STACK - (16 << 20))
+
+void heap_init(struct supplemental_page_table *spt);
+bool heap_copy(struct supplemental_page_table *dst, struct supplemental_page_table *src);
+void heap_kill(struct supplemental_page_table *spt);
+void heap_set_start(void *end);
+void *do_sbrk(intptr_t increment);
+void *do_mmap_anon(void *addr, size_t length, int flags);
+bool do_munmap_anon(void *addr);
+void *heap_map(void *addr, size_t length, int flags, struct shm_segment *shm);
+bool heap_unmap(void *addr, bool shm_only);
+
+#endif /* vm/heap.h */
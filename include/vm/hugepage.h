@@ -0,0 +1,19 @@
+#ifndef VM_HUGEPAGE_H
+#define VM_HUGEPAGE_H
+#include "threads/pte.h"
+#include <stdbool.h>
+
+struct page;
+
+/* Number of 4 kB pages in one 2 MB page. */
+#define HPAGE_PAGES (HPGSIZE / PGSIZE)
+
+/* Back eligible anonymous memory with 2 MB pages.
+ * Cleared by kernel command-line option "-no-thp". */
+extern bool huge_enabled;
+
+bool huge_fault(struct page *page);
+bool huge_split(struct page *page);
+void huge_print_stats(void);
+
+#endif /* vm/hugepage.h */
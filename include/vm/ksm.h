@@ -0,0 +1,15 @@
+#ifndef VM_KSM_H
+#define VM_KSM_H
+#include <stddef.h>
+
+struct frame;
+
+/* Number of frames ksmd scans per wakeup, 0 to disable merging.
+ * Controlled by kernel command-line option "-ksm=PAGES". */
+extern size_t ksm_pages_to_scan;
+
+void ksm_init(void);
+void ksm_forget(struct frame *frame);
+void ksm_print_stats(void);
+
+#endif /* vm/ksm.h */
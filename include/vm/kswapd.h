@@ -0,0 +1,16 @@
+#ifndef VM_KSWAPD_H
+#define VM_KSWAPD_H
+#include <stddef.h>
+
+/* Free user frame watermarks.  kswapd wakes when the number of free
+ * frames drops below the low one and reclaims up to the high one.
+ * Controlled by kernel command-line options "-wmark-low=PAGES" and
+ * "-wmark-high=PAGES"; a low watermark of 0 disables kswapd. */
+extern size_t kswapd_low_wmark;
+extern size_t kswapd_high_wmark;
+
+void kswapd_init(void);
+void kswapd_poke(void);
+void kswapd_print_stats(void);
+
+#endif /* vm/kswapd.h */
@@ -0,0 +1,23 @@
+#ifndef VM_LOADCTL_H
+#define VM_LOADCTL_H
+#include <stdbool.h>
+#include <stddef.h>
+
+struct thread;
+
+/* Pages swapped in, and out, per second above which memory is
+ * considered overcommitted; 0 disables load control and SIZE_MAX
+ * derives the rate from the user pool size.
+ * Controlled by kernel command-line option "-thrash=PAGES". */
+extern size_t loadctl_threshold;
+
+/* Print each suspension and resumption as it happens.
+ * Controlled by kernel command-line option "-thrash-log". */
+extern bool loadctl_verbose;
+
+void loadctl_init(void);
+void loadctl_checkpoint(void);
+void loadctl_exit(struct thread *t);
+void loadctl_print_stats(void);
+
+#endif /* vm/loadctl.h */
@@ -0,0 +1,11 @@
+#ifndef VM_MADVISE_H
+#define VM_MADVISE_H
+#include <stddef.h>
+
+struct thread;
+
+void madvise_init(void);
+int do_madvise(void *addr, size_t length, int advice);
+void madvise_cancel(struct thread *t);
+
+#endif /* vm/madvise.h */
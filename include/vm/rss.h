@@ -0,0 +1,26 @@
+#ifndef VM_RSS_H
+#define VM_RSS_H
+#include <mman.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+struct thread;
+
+/* Resident-set limit in pages given to the first process, 0 for none.
+ * Controlled by kernel command-line option "-rss-limit=PAGES". */
+extern size_t rss_default_limit;
+
+/* Ticks between two working-set samples, 0 (the default) to disable
+ * sampling.  Without samples, load control picks processes by resident
+ * set alone.  Controlled by kernel command-line option "-wss=TICKS". */
+extern int wss_interval;
+
+void rss_init(void);
+void rss_charge(struct thread *t, int delta);
+bool rss_over_limit(struct thread *t);
+void rss_note_self_eviction(void);
+int rss_set_limit(size_t pages);
+int rss_query(struct mem_usage *buf);
+void rss_print_stats(void);
+
+#endif /* vm/rss.h */
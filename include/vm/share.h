@@ -0,0 +1,14 @@
+#ifndef VM_SHARE_H
+#define VM_SHARE_H
+#include <stdbool.h>
+
+struct page;
+struct frame;
+
+void share_init(void);
+bool share_claim(struct page *page);
+bool share_register(struct page *page);
+void share_forget(struct frame *frame);
+void share_print_stats(void);
+
+#endif /* vm/share.h */
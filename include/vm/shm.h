@@ -0,0 +1,36 @@
+#ifndef VM_SHM_H
+#define VM_SHM_H
+#include <list.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+struct frame;
+struct page;
+struct thread;
+struct shm_segment;
+
+/* Largest shared memory segment, in pages. */
+#define SHM_MAX_PAGES 4096
+
+/* A page of a process through which it sees a page of a segment. */
+struct shm_page {
+    struct shm_segment *seg; /* Segment attached. */
+    size_t idx;              /* Page number within SEG. */
+    struct list_elem elem;   /* In the mappers of the segment page. */
+};
+
+void shm_init(void);
+int shm_create(size_t size);
+void *shm_attach(int id, void *addr, int flags);
+int shm_detach(void *addr);
+void shm_exit(struct thread *t);
+
+void shm_get(struct shm_segment *seg);
+void shm_put(struct shm_segment *seg);
+bool shm_add_page(struct shm_segment *seg, size_t idx, void *va, bool writable);
+bool shm_copy_page(struct page *page);
+bool shm_claim(struct page *page);
+bool shm_register(struct page *page);
+bool shm_swap_out(struct frame *frame);
+
+#endif /* vm/shm.h */
@@ -2,6 +2,7 @@
 #define VM_VM_H
 #include <stdbool.h>
 #include "threads/palloc.h"
+#include "threads/synch.h"
 #include "include/lib/kernel/hash.h"
 
 enum vm_type {
@@ -13,6 +14,8 @@ enum vm_type {
     VM_FILE = 2,
     /* page that hold the page cache, for project 4 */
     VM_PAGE_CACHE = 3,
+    /* page of a shared memory segment, see vm/shm.c */
+    VM_SHM = 4,
 
     /* Bit flags to store state */
 
@@ -28,6 +31,7 @@ enum vm_type {
 #include "vm/uninit.h"
 #include "vm/anon.h"
 #include "vm/file.h"
+#include "vm/shm.h"
 #ifdef EFILESYS
 #include "filesys/page_cache.h"
 #endif
@@ -45,29 +49,42 @@ struct page {
     const struct page_operations *operations;
     void *va;            /* Address in terms of user space */
     struct frame *frame; /* Back reference for frame */
+    struct thread *owner; /* Process whose address space maps VA */
+    uint64_t *pte;        /* 4 kB PTE that maps VA, or NULL; see vm_map_page */
     size_t slot_no;
     /* Your implementation */
     struct hash_elem hash_elem;
     bool writable ;
     bool parent_writable;
+    uint8_t advice;       /* Access pattern hint, MADV_* */
     /* Per-type data are binded into the union.
      * Each function automatically detects the current union */
     union {
         struct uninit_page uninit;
         struct anon_page anon;
         struct file_page file;
+        struct shm_page shm;
 #ifdef EFILESYS
         struct page_cache page_cache;
 #endif
     };
 };
 
-/* The representation of "frame" */
+/* The representation of "frame".
+ * There is one descriptor per page of the user pool, in frame_table,
+ * indexed by physical page number; see vm_kva_to_frame(). */
 struct frame {
     void *kva;
-    struct page *page;
-    struct list_elem frame_elem;
-    int ref_cnt;
+    struct page *page;  /* Owning page, NULL if unknown while shared */
+    int ref_cnt;        /* Number of pages mapping this frame, 0 if free */
+    bool pinned;        /* Being filled or evicted; not evictable */
+    bool ksm;           /* Read-only frame merged by ksmd */
+    unsigned ksm_hash;  /* Content checksum while in the ksm table */
+    struct hash_elem ksm_elem;
+    bool ksm_listed;    /* True if ksm_elem is in the ksm table */
+    struct share_entry *share; /* Entry in the shared text cache, if any */
+    bool huge;          /* Part of a 2 MB page of frame->page's owner */
+    struct shm_slot *shm; /* Page of a shared memory segment held, if any */
 };
 
 /* The function table for page operations.
@@ -92,6 +109,11 @@ struct page_operations {
  * All designs up to you for this. */
 struct supplemental_page_table {
     struct hash hash_spt;
+    struct lock lock; /* Serializes faults and mapping changes with prefetch */
+    uint8_t *heap_start;   /* Start of the heap; see vm/heap.c */
+    uint8_t *heap_brk;     /* Current program break */
+    struct list anon_maps; /* Anonymous mappings, highest first */
+    bool dying;            /* Being torn down; see supplemental_page_table_kill() */
 };
 
 #include "threads/thread.h"
@@ -104,7 +126,17 @@ struct page *spt_find_page(struct supplemental_page_table *spt,
 bool spt_insert_page(struct supplemental_page_table *spt, struct page *page);
 void spt_remove_page(struct supplemental_page_table *spt, struct page *page);
 
+/* Fault-around window, settable from 16 to 64 kB with "-fault-around". */
+#define FAULT_AROUND_MIN (16 * 1024)
+#define FAULT_AROUND_MAX (64 * 1024)
+#define FAULT_AROUND_DEFAULT FAULT_AROUND_MAX
+extern size_t fault_around_bytes;
+
+/* Populate executables at load time ("-prefault"). */
+extern bool vm_prefault_exec;
+
 void vm_init(void);
+void vm_print_stats(void);
 bool vm_try_handle_fault(struct intr_frame *f, void *addr, bool user,
                          bool write, bool not_present);
 
@@ -119,5 +151,20 @@ enum vm_type page_get_type(struct page *page);
 unsigned page_hash(const struct hash_elem *p_, void *aux UNUSED);
 bool page_less(const struct hash_elem *a_,const struct hash_elem *b_, void *aux UNUSED) ;
 void free_frame(struct frame *frame);
+void vm_put_frame(struct frame *frame);
+void unpin_frame(struct frame *frame);
+void vm_unpin_frame(struct frame *frame);
+void vm_wait_unpinned(void);
+struct frame *vm_kva_to_frame(void *kva);
+void vm_set_frame(struct page *page, struct frame *frame);
+void vm_release_frame(struct page *page);
+bool vm_map_page(struct page *page, void *kva, bool writable);
+void vm_unmap_page(struct page *page);
+uint64_t *vm_page_pte(struct page *page);
+struct frame *vm_try_get_frame(void);
+bool vm_reclaim_frame(void);
+bool vm_prefetch_page(struct page *page);
+bool vm_populate(void *addr, size_t length);
+void vm_discard_page(struct page *page);
 
 #endif /* VM_VM_H */
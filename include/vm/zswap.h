@@ -0,0 +1,19 @@
+#ifndef VM_ZSWAP_H
+#define VM_ZSWAP_H
+#include <stdbool.h>
+#include <stddef.h>
+
+/* Compressed in-memory swap tier that sits in front of the swap disk. */
+struct zswap_entry;
+
+/* Maximum number of kernel pages the compressed pool may use.
+ * Controlled by kernel command-line option "-zswap=PAGES". */
+extern size_t zswap_pool_limit;
+
+void zswap_init(void);
+struct zswap_entry *zswap_store(const void *kva);
+bool zswap_load(struct zswap_entry *entry, void *kva);
+void zswap_free(struct zswap_entry *entry);
+void zswap_print_stats(void);
+
+#endif /* vm/zswap.h */
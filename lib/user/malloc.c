@@ -0,0 +1,421 @@
+#include <malloc.h>
+#include <debug.h>
+#include <round.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+
+/* A user-space memory allocator.
+
+   Every block starts with a 16-byte header holding its size and the
+   size of the block just below it, so that payloads are 16-byte
+   aligned and free blocks can merge with both neighbours.
+
+   Small requests, up to SMALL_MAX bytes with the header, are rounded
+   up to one of SMALL_CLASSES size classes.  Each class keeps a list of
+   freed blocks; an empty list falls back to a bump pointer inside the
+   current run, a RUN_SIZE block taken from the heap.  Small blocks
+   are never merged and stay in their class once freed.
+
+   Larger requests are carved out of the heap, which grows with sbrk()
+   at its top.  Freed large blocks merge with free neighbours and wait
+   in bins of blocks of similar size, one bin per power of two.  A free
+   block that reaches the top goes back into it, and the top is handed
+   back to the kernel with sbrk() once it exceeds TRIM_THRESHOLD.  Free
+   blocks of RELEASE_MIN bytes or more in the middle of the heap give
+   their inner pages back with madvise(MADV_DONTNEED).
+
+   Requests of MMAP_THRESHOLD bytes or more get an anonymous mapping
+   of their own, unmapped again by free(). */
+
+#define HDR_SIZE 16                 /* Block header size and alignment. */
+#define SMALL_MAX 2048              /* Largest small block. */
+#define SMALL_CLASSES 24            /* Number of small size classes. */
+#define RUN_SIZE (32 * 1024)        /* Run that small blocks come from. */
+#define LARGE_BINS 32               /* Bins of free large blocks. */
+#define MIN_SPLIT 64                /* Smallest free remainder kept. */
+#define HEAP_GROW (64 * 1024)       /* Least sbrk() increment. */
+#define TRIM_THRESHOLD (256 * 1024) /* Free top kept before trimming. */
+#define RELEASE_MIN (64 * 1024)     /* Free block size given back. */
+#define MMAP_THRESHOLD (128 * 1024) /* Smallest block with own mapping. */
+#define PAGE_SIZE 4096
+
+/* Flags in the low bits of a block's size. */
+#define B_USED 1  /* Allocated, or a run or fence. */
+#define B_SMALL 2 /* Small block, inside a run. */
+#define B_MMAP 4  /* Block with its own mapping. */
+#define B_FLAGS (B_USED | B_SMALL | B_MMAP)
+
+struct block {
+    size_t prev_size;   /* Size of the block below, in the heap. */
+    size_t size;        /* Size with header, and B_* flags. */
+    struct block *next; /* In a free list: next free block. */
+    struct block *prev; /* In a large bin: previous free block. */
+};
+
+static struct block *small_free[SMALL_CLASSES]; /* Freed small blocks. */
+static struct block *large_bins[LARGE_BINS];    /* Free large blocks. */
+
+static uint8_t *run_ptr, *run_end; /* Unused part of the current run. */
+
+/* The heap is [heap_start, top) in blocks, followed by the unused top
+   [top, heap_end), which always has room for a header.  top_prev is
+   the size of the block just below the top. */
+static uint8_t *heap_start, *top, *heap_end;
+static size_t top_prev;
+
+static inline size_t
+block_size(const struct block *b) {
+    return b->size & ~(size_t)B_FLAGS;
+}
+
+static inline struct block *
+next_block(struct block *b) {
+    return (struct block *)((uint8_t *)b + block_size(b));
+}
+
+static inline void *
+payload(struct block *b) {
+    return (uint8_t *)b + HDR_SIZE;
+}
+
+/* Sets B's size and flags and tells the block above. */
+static void
+set_size(struct block *b, size_t size, size_t flags) {
+    b->size = size | flags;
+    if ((uint8_t *)b + size == top)
+        top_prev = size;
+    else
+        ((struct block *)((uint8_t *)b + size))->prev_size = size;
+}
+
+/* Returns the class of small block size SIZE: 16-byte steps up to 128
+   bytes, then four steps per power of two. */
+static unsigned
+small_class(size_t size) {
+    unsigned log = 7;
+
+    if (size <= 128)
+        return (size - 1) / 16;
+    while (((size_t)1 << (log + 1)) < size)
+        log++;
+    return 8 + (log - 7) * 4 + (size - ((size_t)1 << log) - 1) / ((size_t)1 << (log - 2));
+}
+
+/* Returns the block size of small class CLS. */
+static size_t
+class_size(unsigned cls) {
+    unsigned log;
+
+    if (cls < 8)
+        return (cls + 1) * 16;
+    log = 7 + (cls - 8) / 4;
+    return ((size_t)1 << log) + ((cls - 8) % 4 + 1) * ((size_t)1 << (log - 2));
+}
+
+/* Returns the bin of free large blocks of SIZE bytes. */
+static unsigned
+large_bin(size_t size) {
+    unsigned bin = 0;
+
+    while (bin < LARGE_BINS - 1 && ((size_t)1 << (bin + 1)) <= size)
+        bin++;
+    return bin;
+}
+
+static void
+bin_insert(struct block *b) {
+    struct block **head = &large_bins[large_bin(block_size(b))];
+
+    b->prev = NULL;
+    b->next = *head;
+    if (*head != NULL)
+        (*head)->prev = b;
+    *head = b;
+}
+
+static void
+bin_remove(struct block *b) {
+    if (b->prev != NULL)
+        b->prev->next = b->next;
+    else
+        large_bins[large_bin(block_size(b))] = b->next;
+    if (b->next != NULL)
+        b->next->prev = b->prev;
+}
+
+/* Grows the top to at least SIZE bytes plus room for a header.
+   Returns false if the kernel refuses. */
+static bool
+grow_top(size_t size) {
+    size_t want = ROUND_UP(size + HDR_SIZE - (heap_end - top), PAGE_SIZE);
+    uint8_t *p;
+
+    if (want < HEAP_GROW)
+        want = HEAP_GROW;
+    p = sbrk(want);
+    if (p == (void *)-1)
+        return false;
+
+    if (p != heap_end) {
+        /* First call, or someone else moved the break.  Turn the old
+           top into a used block and start over in the new space, behind
+           a used block that keeps the first free block from looking
+           for a neighbour below it. */
+        struct block *fence;
+
+        if (top != NULL) {
+            fence = (struct block *)top;
+            fence->prev_size = top_prev;
+            fence->size = (heap_end - top) | B_USED;
+        }
+        fence = (struct block *)p;
+        fence->prev_size = 0;
+        fence->size = HDR_SIZE | B_USED;
+        heap_start = p;
+        top = p + HDR_SIZE;
+        top_prev = HDR_SIZE;
+        heap_end = p + want;
+        return grow_top(size);
+    }
+    heap_end += want;
+    return true;
+}
+
+/* Takes a block of SIZE bytes from the top. */
+static struct block *
+carve_top(size_t size) {
+    struct block *b;
+
+    if ((size_t)(heap_end - top) < size + HDR_SIZE && !grow_top(size))
+        return NULL;
+    b = (struct block *)top;
+    b->prev_size = top_prev;
+    top += size;
+    set_size(b, size, B_USED);
+    return b;
+}
+
+/* Gives the free top above TRIM_THRESHOLD back to the kernel. */
+static void
+trim_top(void) {
+    size_t excess = heap_end - top;
+
+    if (excess <= TRIM_THRESHOLD)
+        return;
+    excess = (excess - TRIM_THRESHOLD / 2) / PAGE_SIZE * PAGE_SIZE;
+    if (sbrk(-(intptr_t)excess) != (void *)-1)
+        heap_end -= excess;
+}
+
+/* Returns a block of at least SIZE bytes, a multiple of HDR_SIZE,
+   from the bins or else from the top. */
+static struct block *
+alloc_large(size_t size) {
+    for (unsigned bin = large_bin(size); bin < LARGE_BINS; bin++) {
+        struct block *b;
+
+        for (b = large_bins[bin]; b != NULL; b = b->next)
+            if (block_size(b) >= size)
+                break;
+        if (b == NULL)
+            continue;
+
+        bin_remove(b);
+        if (block_size(b) - size >= MIN_SPLIT) {
+            struct block *rest = (struct block *)((uint8_t *)b + size);
+
+            rest->prev_size = size;
+            set_size(rest, block_size(b) - size, 0);
+            bin_insert(rest);
+            set_size(b, size, B_USED);
+        } else
+            b->size |= B_USED;
+        return b;
+    }
+    return carve_top(size);
+}
+
+/* Frees large block B, merging it with free neighbours. */
+static void
+free_large(struct block *b) {
+    size_t size = block_size(b);
+    struct block *next = next_block(b);
+
+    if ((uint8_t *)next != top && !(next->size & B_USED)) {
+        bin_remove(next);
+        size += block_size(next);
+    }
+    if (b->prev_size != 0) {
+        struct block *prev = (struct block *)((uint8_t *)b - b->prev_size);
+
+        if (!(prev->size & B_USED)) {
+            bin_remove(prev);
+            size += block_size(prev);
+            b = prev;
+        }
+    }
+
+    if ((uint8_t *)b + size == top) {
+        top = (uint8_t *)b;
+        top_prev = b->prev_size;
+        trim_top();
+        return;
+    }
+    set_size(b, size, 0);
+    bin_insert(b);
+
+    if (size >= RELEASE_MIN) {
+        uint8_t *start = (uint8_t *)ROUND_UP((uintptr_t)(b + 1), PAGE_SIZE);
+        uint8_t *end = (uint8_t *)((uintptr_t)((uint8_t *)b + size) / PAGE_SIZE * PAGE_SIZE);
+
+        if (start < end)
+            madvise(start, end - start, MADV_DONTNEED);
+    }
+}
+
+/* Returns a small block of class CLS. */
+static struct block *
+alloc_small(unsigned cls) {
+    size_t size = class_size(cls);
+    struct block *b = small_free[cls];
+
+    if (b != NULL) {
+        small_free[cls] = b->next;
+        return b;
+    }
+
+    if ((size_t)(run_end - run_ptr) < size) {
+        struct block *run = alloc_large(RUN_SIZE);
+
+        if (run == NULL)
+            return NULL;
+        run_ptr = payload(run);
+        run_end = (uint8_t *)run + RUN_SIZE;
+    }
+    b = (struct block *)run_ptr;
+    run_ptr += size;
+    b->size = size | B_USED | B_SMALL;
+    return b;
+}
+
+/* Returns a block with its own mapping of SIZE bytes. */
+static struct block *
+alloc_mmap(size_t size) {
+    struct block *b;
+
+    size = ROUND_UP(size, PAGE_SIZE);
+    b = mmap(NULL, size, MAP_WRITE | MAP_ANON, -1, 0);
+    if (b == NULL)
+        return NULL;
+    b->prev_size = 0;
+    b->size = size | B_USED | B_MMAP;
+    return b;
+}
+
+/* Returns the block size needed for SIZE bytes of payload, or 0 if
+   SIZE is too big. */
+static size_t
+request_size(size_t size) {
+    if (size > SIZE_MAX / 2)
+        return 0;
+    return ROUND_UP(size + HDR_SIZE, HDR_SIZE);
+}
+
+/* Obtains and returns a new block of at least SIZE bytes.
+   Returns a null pointer if memory is not available. */
+void *
+malloc(size_t size) {
+    size_t need = request_size(size);
+    struct block *b;
+
+    if (need == 0)
+        return NULL;
+    if (need <= SMALL_MAX)
+        b = alloc_small(small_class(need));
+    else if (need >= MMAP_THRESHOLD)
+        b = alloc_mmap(need);
+    else
+        b = alloc_large(need);
+    return b != NULL ? payload(b) : NULL;
+}
+
+/* Allocates and return A times B bytes initialized to zeroes.
+   Returns a null pointer if memory is not available. */
+void *
+calloc(size_t a, size_t b) {
+    void *p;
+
+    if (b != 0 && a > SIZE_MAX / b)
+        return NULL;
+    p = malloc(a * b);
+    if (p != NULL)
+        memset(p, 0, a * b);
+    return p;
+}
+
+/* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly moving it
+   in the process.  If successful, returns the new block; on failure,
+   returns a null pointer.  A call with null OLD_BLOCK is equivalent
+   to malloc(NEW_SIZE).  A call with zero NEW_SIZE is equivalent to
+   free(OLD_BLOCK). */
+void *
+realloc(void *old_block, size_t new_size) {
+    struct block *b;
+    size_t need, old_size;
+    void *new_block;
+
+    if (old_block == NULL)
+        return malloc(new_size);
+    if (new_size == 0) {
+        free(old_block);
+        return NULL;
+    }
+
+    b = (struct block *)((uint8_t *)old_block - HDR_SIZE);
+    old_size = block_size(b);
+    need = request_size(new_size);
+    if (need == 0)
+        return NULL;
+    if (need <= old_size)
+        return old_block;
+
+    /* A large block at the top of the heap grows in place. */
+    if (!(b->size & (B_SMALL | B_MMAP)) && (uint8_t *)b + old_size == top && need < MMAP_THRESHOLD
+        && ((size_t)(heap_end - top) >= need - old_size + HDR_SIZE || grow_top(need - old_size))
+        && (uint8_t *)b + old_size == top) {
+        top += need - old_size;
+        set_size(b, need, B_USED);
+        return old_block;
+    }
+
+    new_block = malloc(new_size);
+    if (new_block == NULL)
+        return NULL;
+    memcpy(new_block, old_block, old_size - HDR_SIZE);
+    free(old_block);
+    return new_block;
+}
+
+/* Frees block P, which must have been previously allocated with
+   malloc(), calloc(), or realloc(). */
+void
+free(void *p) {
+    struct block *b;
+
+    if (p == NULL)
+        return;
+    b = (struct block *)((uint8_t *)p - HDR_SIZE);
+    ASSERT(b->size & B_USED);
+
+    if (b->size & B_SMALL) {
+        unsigned cls = small_class(block_size(b));
+
+        b->next = small_free[cls];
+        small_free[cls] = b;
+    } else if (b->size & B_MMAP)
+        munmap(b);
+    else
+        free_large(b);
+}
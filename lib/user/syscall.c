@@ -85,6 +85,10 @@ int exec(const char *file) {
     return (pid_t)syscall1(SYS_EXEC, file);
 }
 
+pid_t spawn(const char *file, char *const argv[], const struct spawn_fd_action *actions) {
+    return (pid_t)syscall3(SYS_SPAWN, file, argv, actions);
+}
+
 int wait(pid_t pid) {
     return syscall1(SYS_WAIT, pid);
 }
@@ -139,6 +143,48 @@ void munmap(void *addr) {
     syscall1(SYS_MUNMAP, addr);
 }
 
+int madvise(void *addr, size_t length, int advice) {
+    return syscall3(SYS_MADVISE, addr, length, advice);
+}
+
+int msync(void *addr, size_t length) {
+    return syscall2(SYS_MSYNC, addr, length);
+}
+
+int fault_stats(struct fault_stats *stats, bool global) {
+    return syscall2(SYS_FAULT_STATS, stats, global);
+}
+
+int rss_limit(size_t pages) {
+    return syscall1(SYS_RSS_LIMIT, pages);
+}
+
+int mem_usage(struct mem_usage *usage) {
+    return syscall1(SYS_MEM_USAGE, usage);
+}
+
+void *sbrk(intptr_t increment) {
+    return (void *)syscall1(SYS_SBRK, increment);
+}
+
+int brk(void *addr) {
+    char *cur = sbrk(0);
+
+    return sbrk((char *)addr - cur) == (void *)-1 ? -1 : 0;
+}
+
+int shm_create(size_t size) {
+    return syscall1(SYS_SHM_CREATE, size);
+}
+
+void *shm_attach(int id, void *addr, int flags) {
+    return (void *)syscall3(SYS_SHM_ATTACH, id, addr, flags);
+}
+
+int shm_detach(void *addr) {
+    return syscall1(SYS_SHM_DETACH, addr);
+}
+
 bool chdir(const char *dir) {
     return syscall1(SYS_CHDIR, dir);
 }
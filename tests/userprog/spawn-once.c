@@ -0,0 +1,20 @@
+/* Spawns a single child process with spawn() and waits for it. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void) 
+{
+  char *argv[] = {"child-simple", NULL};
+  pid_t pid;
+
+  msg ("I'm your father");
+  pid = spawn ("child-simple", argv, NULL);
+  if (pid == PID_ERROR)
+    fail ("spawn child-simple failed");
+  msg ("wait(spawn()) = %d", wait (pid));
+  CHECK (spawn ("no-such-file", NULL, NULL) == PID_ERROR,
+         "spawn missing file");
+}
@@ -0,0 +1,28 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF', <<'EOF']);
+(spawn-once) begin
+(spawn-once) I'm your father
+(child-simple) run
+child-simple: exit(81)
+(spawn-once) wait(spawn()) = 81
+load: no-such-file: open failed
+no-such-file: exit(-1)
+(spawn-once) spawn missing file
+(spawn-once) end
+spawn-once: exit(0)
+EOF
+(spawn-once) begin
+(spawn-once) I'm your father
+(child-simple) run
+child-simple: exit(81)
+(spawn-once) wait(spawn()) = 81
+load: no-such-file: open failed
+(spawn-once) spawn missing file
+no-such-file: exit(-1)
+(spawn-once) end
+spawn-once: exit(0)
+EOF
+pass;
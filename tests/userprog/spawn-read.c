@@ -0,0 +1,41 @@
+/* Reads the start of a file, then spawns a child that is handed the
+   open descriptor under another number and reads the rest. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/boundary.h"
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define CHILD_FD 7
+
+void
+test_main (void) 
+{
+  char child_fd[16];
+  char *argv[] = {"child-read", child_fd, NULL};
+  struct spawn_fd_action actions[] = {{0, 0}, {1, 1}, {0, CHILD_FD},
+                                      {-1, -1}};
+  pid_t pid;
+  int handle;
+  char *buffer;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  buffer = get_boundary_area () - sizeof sample / 2;
+  CHECK (read (handle, buffer, 20) == 20, "read \"sample.txt\" first 20 bytes");
+
+  actions[2].fd = handle;
+  snprintf (child_fd, sizeof child_fd, "%d", CHILD_FD);
+  pid = spawn ("child-read", argv, actions);
+  if (pid == PID_ERROR)
+    fail ("spawn child-read failed");
+  msg ("wait(spawn()) = %d", wait (pid));
+
+  CHECK (read (handle, buffer + 20, sizeof sample - 21) == sizeof sample - 21,
+         "read \"sample.txt\" remainders");
+  if (strcmp (sample, buffer))
+    fail ("expected text differs from actual");
+  close (handle);
+}
@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(spawn-read) begin
+(spawn-read) open "sample.txt"
+(spawn-read) read "sample.txt" first 20 bytes
+(child-read) begin
+(child-read) open "sample.txt"
+(child-read) read "sample.txt" first 20 bytes
+(child-read) read "sample.txt" remainders
+(child-read) Child success
+(child-read) end
+child-read: exit(0)
+(spawn-read) wait(spawn()) = 0
+(spawn-read) read "sample.txt" remainders
+(spawn-read) end
+spawn-read: exit(0)
+EOF
+pass;
@@ -0,0 +1,45 @@
+/* Touches fresh pages and checks that fault_stats() counts the faults,
+   both for this process and globally. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGES 4
+
+static char buf[PAGES * 4096] __attribute__ ((aligned (4096)));
+static struct fault_stats before, after, global;
+
+static unsigned long long
+total (const struct fault_stats *stats)
+{
+  unsigned long long sum = 0;
+  int kind;
+
+  for (kind = 0; kind < FAULT_KIND_CNT; kind++)
+    sum += stats->count[kind];
+  return sum;
+}
+
+void
+test_main (void)
+{
+  int i;
+
+  CHECK (fault_stats (&before, false) == 0, "read process fault stats");
+  for (i = 0; i < PAGES; i++)
+    buf[i * 4096] = 1;
+  CHECK (fault_stats (&after, false) == 0, "read process fault stats again");
+  if (total (&after) < total (&before) + PAGES)
+    fail ("%llu faults counted for %d fresh pages",
+          total (&after) - total (&before), PAGES);
+
+  CHECK (fault_stats (&global, true) == 0, "read global fault stats");
+  if (total (&global) < total (&after))
+    fail ("global count %llu is below process count %llu",
+          total (&global), total (&after));
+
+  CHECK (fault_stats ((struct fault_stats *) 0x8004000000, false) == -1,
+         "kernel pointer rejected");
+}
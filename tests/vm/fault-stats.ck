@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fault-stats) begin
+(fault-stats) read process fault stats
+(fault-stats) read process fault stats again
+(fault-stats) read global fault stats
+(fault-stats) kernel pointer rejected
+(fault-stats) end
+EOF
+pass;
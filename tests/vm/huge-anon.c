@@ -0,0 +1,45 @@
+/* Fills a 2 MB-aligned anonymous region, checks that the kernel backed
+   it with 2 MB pages, then discards single pages inside it, which splits
+   such a page, and checks that every other page keeps its contents. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define HUGE (2 * 1024 * 1024)
+#define SIZE (2 * HUGE)
+
+static char buf[SIZE] __attribute__ ((aligned (HUGE)));
+
+void
+test_main (void)
+{
+  struct mem_usage usage;
+  size_t i;
+
+  for (i = 0; i < SIZE; i += 4096)
+    buf[i] = i / 4096 % 251 + 1;
+  msg ("filled %d MB", SIZE / 1024 / 1024);
+
+  CHECK (mem_usage (&usage) == 0, "read memory usage");
+  if (usage.huge_faults == 0)
+    fail ("no 2 MB page was mapped");
+  msg ("mapped by 2 MB pages");
+
+  CHECK (madvise (buf + 4096, 4096, MADV_DONTNEED) == 0,
+         "discard one page of the first 2 MB");
+  CHECK (madvise (buf + HUGE + 8 * 4096, 4096, MADV_DONTNEED) == 0,
+         "discard one page of the second 2 MB");
+
+  for (i = 0; i < SIZE; i += 4096)
+    {
+      char expected = i / 4096 % 251 + 1;
+
+      if (i == 4096 || i == HUGE + 8 * 4096)
+        expected = 0;
+      if (buf[i] != expected)
+        fail ("page %zu reads %d, should be %d", i / 4096, buf[i], expected);
+    }
+  msg ("contents intact");
+}
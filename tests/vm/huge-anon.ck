@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(huge-anon) begin
+(huge-anon) filled 4 MB
+(huge-anon) read memory usage
+(huge-anon) mapped by 2 MB pages
+(huge-anon) discard one page of the first 2 MB
+(huge-anon) discard one page of the second 2 MB
+(huge-anon) contents intact
+(huge-anon) end
+EOF
+pass;
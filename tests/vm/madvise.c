@@ -0,0 +1,50 @@
+/* Exercises each madvise() hint on anonymous and file-backed memory:
+   DONTNEED must read back zeroes for anonymous pages and keep written
+   data for file mappings, and bad arguments must be rejected. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (8 * 4096)
+
+static char buf[SIZE] __attribute__ ((aligned (4096)));
+
+void
+test_main (void)
+{
+  char *actual = (char *) 0x10000000;
+  int handle;
+  void *map;
+  size_t i;
+
+  /* Anonymous memory. */
+  CHECK (madvise (buf, SIZE, MADV_SEQUENTIAL) == 0, "madvise sequential");
+  memset (buf, 'x', SIZE);
+  CHECK (madvise (buf, SIZE, MADV_DONTNEED) == 0, "madvise dontneed");
+  for (i = 0; i < SIZE; i++)
+    if (buf[i] != 0)
+      fail ("byte %zu of discarded page has value %02hhx (should be 0)",
+            i, buf[i]);
+  CHECK (madvise (buf, SIZE, MADV_NORMAL) == 0, "madvise normal");
+
+  /* File-backed memory. */
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK ((map = mmap (actual, 4096, 1, handle, 0)) != MAP_FAILED,
+         "mmap \"sample.txt\"");
+  CHECK (madvise (actual, 4096, MADV_RANDOM) == 0, "madvise random");
+  actual[0] = 'S';
+  CHECK (madvise (actual, 4096, MADV_DONTNEED) == 0, "madvise dontneed");
+  CHECK (madvise (actual, 4096, MADV_WILLNEED) == 0, "madvise willneed");
+  if (actual[0] != 'S' || memcmp (actual + 1, sample + 1, strlen (sample) - 1))
+    fail ("mmap'd file lost data across MADV_DONTNEED");
+  munmap (map);
+  close (handle);
+
+  /* Bad arguments. */
+  CHECK (madvise (buf + 1, 4096, MADV_NORMAL) == -1, "madvise misaligned");
+  CHECK (madvise (buf, 4096, 1234) == -1, "madvise bad advice");
+  CHECK (madvise (NULL, 4096, MADV_NORMAL) == -1, "madvise null");
+}
@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(madvise) begin
+(madvise) madvise sequential
+(madvise) madvise dontneed
+(madvise) madvise normal
+(madvise) open "sample.txt"
+(madvise) mmap "sample.txt"
+(madvise) madvise random
+(madvise) madvise dontneed
+(madvise) madvise willneed
+(madvise) madvise misaligned
+(madvise) madvise bad advice
+(madvise) madvise null
+(madvise) end
+EOF
+pass;
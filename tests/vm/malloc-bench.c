@@ -0,0 +1,126 @@
+/* Runs a mixed malloc(), realloc() and free() workload over a table of
+   live blocks, checking each block's contents before it is released,
+   and reports the allocation rate and the peak resident set.  User
+   programs have no clock, so the rate is given per million TSC cycles. */
+
+#include <malloc.h>
+#include <random.h>
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SLOTS 1024
+#define OPS 50000
+
+struct slot {
+  unsigned char *p;
+  size_t size;
+  unsigned char fill;
+};
+
+static struct slot slots[SLOTS];
+
+static inline uint64_t
+read_tsc (void)
+{
+  uint32_t lo, hi;
+  asm volatile ("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((uint64_t) hi << 32) | lo;
+}
+
+/* Returns a request size: mostly small, some medium, a few large. */
+static size_t
+pick_size (void)
+{
+  unsigned long r = random_ulong () % 1000;
+
+  if (r < 900)
+    return 1 + random_ulong () % 512;
+  else if (r < 995)
+    return 4096 + random_ulong () % (60 * 1024);
+  else
+    return 128 * 1024 + random_ulong () % (256 * 1024);
+}
+
+static void
+check_slot (struct slot *s)
+{
+  size_t i;
+
+  for (i = 0; i < s->size; i += 97)
+    if (s->p[i] != s->fill)
+      fail ("block of %zu bytes corrupted at offset %zu", s->size, i);
+}
+
+static void
+update_peak (unsigned long long *peak)
+{
+  struct mem_usage usage;
+
+  if (mem_usage (&usage) == 0 && usage.rss > *peak)
+    *peak = usage.rss;
+}
+
+void
+test_main (void)
+{
+  unsigned long long peak = 0, allocs = 0;
+  uint64_t start, cycles;
+  int i;
+
+  random_init (0x5eed);
+  start = read_tsc ();
+  for (i = 0; i < OPS; i++)
+    {
+      struct slot *s = &slots[random_ulong () % SLOTS];
+
+      if (s->p == NULL)
+        {
+          s->size = pick_size ();
+          s->p = malloc (s->size);
+          if (s->p == NULL)
+            fail ("malloc of %zu bytes failed", s->size);
+          allocs++;
+        }
+      else if (random_ulong () % 4 == 0)
+        {
+          size_t size = pick_size ();
+
+          check_slot (s);
+          s->p = realloc (s->p, size);
+          if (s->p == NULL)
+            fail ("realloc to %zu bytes failed", size);
+          if (size < s->size)
+            s->size = size;
+          check_slot (s);
+          s->size = size;
+          allocs++;
+        }
+      else
+        {
+          check_slot (s);
+          free (s->p);
+          s->p = NULL;
+          continue;
+        }
+      s->fill = random_ulong ();
+      memset (s->p, s->fill, s->size);
+      if (i % 1024 == 0)
+        update_peak (&peak);
+    }
+  cycles = read_tsc () - start;
+  update_peak (&peak);
+
+  for (i = 0; i < SLOTS; i++)
+    if (slots[i].p != NULL)
+      {
+        check_slot (&slots[i]);
+        free (slots[i].p);
+      }
+  msg ("%d operations completed", OPS);
+  msg ("allocations per million cycles: %llu",
+       allocs * 1000000 / (cycles != 0 ? cycles : 1));
+  msg ("peak RSS: %llu pages", peak);
+}
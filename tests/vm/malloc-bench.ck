@@ -0,0 +1,22 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+
+common_checks ("run", @output);
+
+my (@core) = get_core_output ("run", @output);
+fail "missing 'begin' message\n"
+  if !grep ($_ eq '(malloc-bench) begin', @core);
+fail "missing 'end' message\n"
+  if !grep ($_ eq '(malloc-bench) end', @core);
+fail "workload did not complete\n"
+  if !grep ($_ eq '(malloc-bench) 50000 operations completed', @core);
+fail "missing allocation rate\n"
+  if !grep (/^\(malloc-bench\) allocations per million cycles: \d+$/, @core);
+fail "missing peak RSS\n"
+  if !grep (/^\(malloc-bench\) peak RSS: \d+ pages$/, @core);
+pass;
@@ -0,0 +1,51 @@
+/* Maps anonymous memory with and without an address, writes it,
+   checks that the mappings are zero-filled and distinct, and unmaps
+   them. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (16 * 4096)
+#define FIXED ((char *) 0x10000000)
+
+void
+test_main (void)
+{
+  char *a, *b, *c;
+  int i;
+
+  a = mmap (NULL, SIZE, MAP_WRITE | MAP_ANON, -1, 0);
+  CHECK (a != NULL, "mmap anonymous memory");
+  b = mmap (NULL, SIZE, MAP_WRITE | MAP_ANON, -1, 0);
+  CHECK (b != NULL, "mmap more anonymous memory");
+  if (a < b + SIZE && b < a + SIZE)
+    fail ("mappings overlap");
+  c = mmap (FIXED, 4096, MAP_WRITE | MAP_ANON, -1, 0);
+  CHECK (c == FIXED, "mmap anonymous memory at a given address");
+  CHECK (mmap (FIXED, 4096, MAP_WRITE | MAP_ANON, -1, 0) == NULL,
+         "mapping over it rejected");
+  CHECK (mmap (NULL, SIZE, MAP_WRITE | MAP_ANON, 0, 0) == NULL,
+         "anonymous mapping with a file rejected");
+
+  for (i = 0; i < SIZE; i++)
+    if (a[i] != 0 || b[i] != 0)
+      fail ("byte %d not zero", i);
+  memset (a, 'a', SIZE);
+  memset (b, 'b', SIZE);
+  c[0] = 'c';
+  for (i = 0; i < SIZE; i += 4096)
+    if (a[i] != 'a' || b[i] != 'b')
+      fail ("page %d lost its contents", i / 4096);
+  msg ("mappings hold their contents");
+
+  munmap (a);
+  munmap (c);
+  a = mmap (NULL, SIZE, MAP_WRITE | MAP_ANON, -1, 0);
+  CHECK (a != NULL, "mmap again after munmap");
+  if (a[0] != 0)
+    fail ("new mapping not zeroed");
+  munmap (a);
+  munmap (b);
+}
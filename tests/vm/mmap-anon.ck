@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-anon) begin
+(mmap-anon) mmap anonymous memory
+(mmap-anon) mmap more anonymous memory
+(mmap-anon) mmap anonymous memory at a given address
+(mmap-anon) mapping over it rejected
+(mmap-anon) anonymous mapping with a file rejected
+(mmap-anon) mappings hold their contents
+(mmap-anon) mmap again after munmap
+(mmap-anon) end
+EOF
+pass;
@@ -0,0 +1,47 @@
+/* Forks a child that maps a file of several pages, writes to all of
+   them and exits without unmapping.  The parent must read the child's
+   data from the file as soon as wait() returns, although the child
+   left the writeback to the kernel. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGES 20
+#define SIZE (PAGES * 4096)
+#define ACTUAL ((char *) 0x10000000)
+
+static char buf[SIZE];
+
+void
+test_main (void)
+{
+  int handle;
+  pid_t child;
+
+  CHECK (create ("data", SIZE), "create \"data\"");
+
+  child = fork ("child-run");
+  if (child == 0)
+    {
+      int child_handle = open ("data");
+
+      if (child_handle < 2)
+        fail ("child could not open \"data\"");
+      if (mmap (ACTUAL, SIZE, MAP_WRITE, child_handle, 0) == MAP_FAILED)
+        fail ("child could not mmap \"data\"");
+      for (int i = 0; i < PAGES; i++)
+        memset (ACTUAL + i * 4096, 'A' + i, 4096);
+      exit (0);
+    }
+  CHECK (wait (child) == 0, "wait for child");
+
+  CHECK ((handle = open ("data")) > 1, "open \"data\"");
+  CHECK (read (handle, buf, SIZE) == SIZE, "read \"data\"");
+  for (int i = 0; i < SIZE; i++)
+    if (buf[i] != 'A' + i / 4096)
+      fail ("byte %d is %d, expected %d", i, buf[i], 'A' + i / 4096);
+  msg ("child's writes are in the file");
+  close (handle);
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-exit-run) begin
+(mmap-exit-run) create "data"
+(mmap-exit-run) wait for child
+(mmap-exit-run) open "data"
+(mmap-exit-run) read "data"
+(mmap-exit-run) child's writes are in the file
+(mmap-exit-run) end
+EOF
+pass;
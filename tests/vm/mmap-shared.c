@@ -0,0 +1,52 @@
+/* Maps a file with MAP_SHARED, then forks a child that maps the same
+   file again on its own and writes through that mapping.  The parent
+   must see the write through its mapping, and in the file. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/vm/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PARENT ((char *) 0x10000000)
+#define CHILD ((char *) 0x20000000)
+
+static const char words[] = "shared words";
+
+void
+test_main (void)
+{
+  char buf[sizeof words];
+  int handle;
+  pid_t child;
+
+  CHECK ((handle = open ("sample.txt")) > 1, "open \"sample.txt\"");
+  CHECK (mmap (PARENT, 4096, MAP_WRITE | MAP_SHARED, handle, 0) != MAP_FAILED,
+         "mmap \"sample.txt\" shared");
+  if (memcmp (PARENT, sample, strlen (sample)))
+    fail ("read of mmap'd file reported bad data");
+
+  child = fork ("child-shared");
+  if (child == 0)
+    {
+      int child_handle = open ("sample.txt");
+
+      if (child_handle < 2)
+        fail ("child could not open \"sample.txt\"");
+      if (mmap (CHILD, 4096, MAP_WRITE | MAP_SHARED, child_handle, 0) == MAP_FAILED)
+        fail ("child could not mmap \"sample.txt\"");
+      memcpy (CHILD, words, sizeof words);
+      if (memcmp (PARENT, words, sizeof words))
+        fail ("write not visible through inherited mapping");
+      exit (0);
+    }
+  CHECK (wait (child) == 0, "wait for child");
+
+  CHECK (!memcmp (PARENT, words, sizeof words),
+         "child's write visible through parent's mapping");
+  munmap (PARENT);
+
+  read (handle, buf, sizeof words);
+  CHECK (!memcmp (buf, words, sizeof words), "child's write reached the file");
+  close (handle);
+}
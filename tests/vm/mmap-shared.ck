@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-shared) begin
+(mmap-shared) open "sample.txt"
+(mmap-shared) mmap "sample.txt" shared
+(mmap-shared) wait for child
+(mmap-shared) child's write visible through parent's mapping
+(mmap-shared) child's write reached the file
+(mmap-shared) end
+EOF
+pass;
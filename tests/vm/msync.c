@@ -0,0 +1,53 @@
+/* Writes to most pages of a file mapping and syncs it with msync(),
+   then reads the file back with read() while the mapping is still in
+   place.  A second write and msync() after the first must reach the
+   file too. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PAGES 8
+#define SIZE (PAGES * 4096)
+#define ACTUAL ((char *) 0x10000000)
+
+static char buf[SIZE];
+
+/* Reads "state" back and compares it with the mapping. */
+static void
+check_state (const char *what)
+{
+  int handle;
+
+  CHECK ((handle = open ("state")) > 1, "open \"state\" for %s", what);
+  CHECK (read (handle, buf, SIZE) == SIZE, "read \"state\" for %s", what);
+  CHECK (!memcmp (buf, ACTUAL, SIZE), "compare %s against mapping", what);
+  close (handle);
+}
+
+void
+test_main (void)
+{
+  int handle;
+
+  CHECK (create ("state", SIZE), "create \"state\"");
+  CHECK ((handle = open ("state")) > 1, "open \"state\"");
+  CHECK (mmap (ACTUAL, SIZE, MAP_WRITE, handle, 0) != MAP_FAILED,
+         "mmap \"state\"");
+
+  /* Leave page 6 clean, so that the dirty pages form two runs. */
+  for (int i = 0; i < PAGES; i++)
+    if (i != 6)
+      memset (ACTUAL + i * 4096, 'a' + i, 4096);
+  CHECK (msync (ACTUAL, SIZE) == 0, "msync");
+  check_state ("first sync");
+
+  memset (ACTUAL + 100, 'z', 5000);
+  CHECK (msync (ACTUAL, 4096 * 2) == 0, "msync again");
+  check_state ("second sync");
+
+  CHECK (msync (ACTUAL + 1, 4096) == -1, "msync unaligned address");
+  munmap (ACTUAL);
+  close (handle);
+}
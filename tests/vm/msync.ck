@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(msync) begin
+(msync) create "state"
+(msync) open "state"
+(msync) mmap "state"
+(msync) msync
+(msync) open "state" for first sync
+(msync) read "state" for first sync
+(msync) compare first sync against mapping
+(msync) msync again
+(msync) open "state" for second sync
+(msync) read "state" for second sync
+(msync) compare second sync against mapping
+(msync) msync unaligned address
+(msync) end
+EOF
+pass;
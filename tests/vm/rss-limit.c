@@ -0,0 +1,41 @@
+/* Sets a resident-set limit, touches more pages than it allows and
+   checks that mem_usage() stays within the limit while every page
+   keeps its contents. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define LIMIT 32
+#define PAGES 128
+
+static char buf[PAGES * 4096] __attribute__ ((aligned (4096)));
+
+void
+test_main (void)
+{
+  struct mem_usage usage;
+  int i;
+
+  CHECK (rss_limit (LIMIT) == 0, "set rss limit to %d pages", LIMIT);
+  for (i = 0; i < PAGES; i++)
+    buf[i * 4096] = i;
+
+  CHECK (mem_usage (&usage) == 0, "read memory usage");
+  if (usage.rss_limit != LIMIT)
+    fail ("limit reads back as %llu", usage.rss_limit);
+  if (usage.rss > LIMIT)
+    fail ("%llu pages resident above a limit of %d", usage.rss, LIMIT);
+  if (usage.wss > usage.rss)
+    fail ("working set %llu above resident set %llu", usage.wss, usage.rss);
+
+  for (i = 0; i < PAGES; i++)
+    if (buf[i * 4096] != (char) i)
+      fail ("page %d lost its contents", i);
+  msg ("all pages intact");
+
+  CHECK (rss_limit (0) == 0, "remove rss limit");
+  CHECK (mem_usage ((struct mem_usage *) 0x8004000000) == -1,
+         "kernel pointer rejected");
+}
@@ -0,0 +1,14 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(rss-limit) begin
+(rss-limit) set rss limit to 32 pages
+(rss-limit) read memory usage
+(rss-limit) all pages intact
+(rss-limit) remove rss limit
+(rss-limit) kernel pointer rejected
+(rss-limit) end
+EOF
+pass;
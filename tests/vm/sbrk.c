@@ -0,0 +1,41 @@
+/* Grows the heap with sbrk(), fills it, shrinks it back and checks
+   that the break moves as asked and that the heap starts zeroed. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (64 * 4096)
+
+void
+test_main (void)
+{
+  char *base, *p;
+  int i;
+
+  base = sbrk (0);
+  CHECK (base != (void *) -1, "read initial break");
+  CHECK (sbrk (SIZE) == base, "grow heap by %d bytes", SIZE);
+  CHECK (sbrk (0) == base + SIZE, "break moved");
+
+  for (i = 0; i < SIZE; i++)
+    if (base[i] != 0)
+      fail ("byte %d of new heap is %d", i, base[i]);
+  memset (base, 0x5a, SIZE);
+  for (i = 0; i < SIZE; i += 4096)
+    if (base[i] != 0x5a)
+      fail ("heap page %d lost its contents", i / 4096);
+  msg ("heap filled");
+
+  CHECK (sbrk (-SIZE / 2) == base + SIZE, "shrink heap by half");
+  CHECK (brk (base + SIZE) == 0, "grow heap back with brk");
+  p = base + SIZE / 2;
+  for (i = 0; i < SIZE / 2; i++)
+    if (p[i] != 0)
+      fail ("byte %d of regrown heap is %d", i, p[i]);
+  msg ("regrown heap is zeroed");
+
+  CHECK (sbrk (-(SIZE + 4096)) == (void *) -1, "shrink below heap start rejected");
+  CHECK (brk (base) == 0, "release heap");
+}
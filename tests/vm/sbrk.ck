@@ -0,0 +1,18 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(sbrk) begin
+(sbrk) read initial break
+(sbrk) grow heap by 262144 bytes
+(sbrk) break moved
+(sbrk) heap filled
+(sbrk) shrink heap by half
+(sbrk) grow heap back with brk
+(sbrk) regrown heap is zeroed
+(sbrk) shrink below heap start rejected
+(sbrk) release heap
+(sbrk) end
+EOF
+pass;
@@ -0,0 +1,51 @@
+/* Creates a shared memory segment and attaches it, then forks a child
+   that attaches the same segment again by its id and writes through
+   that attachment.  The parent must see the write, and detaching must
+   work only where a segment is attached. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (3 * 4096)
+#define CHILD ((char *) 0x20000000)
+
+static const char words[] = "segment words";
+
+void
+test_main (void)
+{
+  char *seg;
+  int id;
+  pid_t child;
+
+  CHECK ((id = shm_create (SIZE)) >= 0, "create segment");
+  CHECK ((seg = shm_attach (id, NULL, MAP_WRITE)) != NULL, "attach segment");
+  for (int i = 0; i < SIZE; i++)
+    if (seg[i] != 0)
+      fail ("segment not zero-filled at byte %d", i);
+
+  child = fork ("child-shm");
+  if (child == 0)
+    {
+      char *mine = shm_attach (id, CHILD, MAP_WRITE);
+
+      if (mine != CHILD)
+        fail ("child could not attach segment");
+      memcpy (mine + 4096, words, sizeof words);
+      if (memcmp (seg + 4096, words, sizeof words))
+        fail ("write not visible through inherited attachment");
+      if (shm_detach (mine) != 0)
+        fail ("child could not detach segment");
+      exit (0);
+    }
+  CHECK (wait (child) == 0, "wait for child");
+
+  CHECK (!memcmp (seg + 4096, words, sizeof words),
+         "child's write visible through parent's attachment");
+  CHECK (shm_detach (seg + 4096) == -1, "detach inside segment fails");
+  CHECK (shm_detach (seg) == 0, "detach segment");
+  CHECK (shm_attach (id + 1000, NULL, MAP_WRITE) == NULL,
+         "attach unknown segment fails");
+}
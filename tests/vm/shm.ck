@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(shm) begin
+(shm) create segment
+(shm) attach segment
+(shm) wait for child
+(shm) child's write visible through parent's attachment
+(shm) detach inside segment fails
+(shm) detach segment
+(shm) attach unknown segment fails
+(shm) end
+EOF
+pass;
@@ -1,4 +1,5 @@
 #include "threads/init.h"
+#include "intrinsic.h"
 #include "devices/input.h"
 #include "devices/kbd.h"
 #include "devices/serial.h"
@@ -31,6 +32,13 @@
 #include "tests/threads/tests.h"
 #ifdef VM
 #include "vm/vm.h"
+#include "vm/faultstat.h"
+#include "vm/hugepage.h"
+#include "vm/ksm.h"
+#include "vm/kswapd.h"
+#include "vm/loadctl.h"
+#include "vm/rss.h"
+#include "vm/zswap.h"
 #endif
 #ifdef FILESYS
 #include "devices/disk.h"
@@ -51,6 +59,9 @@ bool power_off_when_done;
 
 bool thread_tests;
 
+/* -no-pcid: Never tag address spaces with PCIDs. */
+static bool no_pcid;
+
 static void bss_init(void);
 static void paging_init(uint64_t mem_end);
 
@@ -103,6 +114,9 @@ int main(void) {
     thread_start();
     serial_init_queue();
     timer_calibrate();
+#ifdef USERPROG
+    pml4_reaper_init();
+#endif
 
 #ifdef FILESYS
     /* Initialize file system. */
@@ -138,31 +152,77 @@ bss_init(void) {
     memset(&_start_bss, 0, &_end_bss - &_start_bss);
 }
 
+/* Returns true if the CPU supports process-context identifiers, as
+ * reported by CPUID leaf 1. */
+static bool
+cpu_has_pcid(void) {
+    uint32_t regs[4];
+
+    cpuid(1, regs);
+    return (regs[2] & (1 << 17)) != 0;
+}
+
+/* Returns the size of the largest page, out of SIZES, that can map
+ * physical address PA in the direct map: both PA and its kernel
+ * virtual address must be aligned, and the page must end before
+ * MEM_END and stay clear of legacy low memory and of the read-only
+ * kernel text in [TEXT_START, TEXT_END). */
+static uint64_t
+direct_map_page_size(uint64_t pa, uint64_t mem_end, uint64_t text_start,
+                     uint64_t text_end, const uint64_t *sizes) {
+    for (; *sizes != PGSIZE; sizes++) {
+        uint64_t end = pa + *sizes;
+
+        if (pa % *sizes == 0 && (uint64_t)ptov(pa) % *sizes == 0 && end <= mem_end
+            && pa >= 0x100000 && (end <= text_start || pa >= text_end))
+            return *sizes;
+    }
+    return PGSIZE;
+}
+
 /* Populates the page table with the kernel virtual mapping,
  * and then sets up the CPU to use the new page directory.
- * Points base_pml4 to the pml4 it creates. */
+ * Points base_pml4 to the pml4 it creates.
+ * Physical memory is mapped with 2 MB pages, falling back to 4 kB pages
+ * for low memory, the kernel text and the unaligned tail.  1 GB pages
+ * are not used: KERN_BASE is not 1 GB aligned, so no kernel virtual
+ * address could be mapped by one. */
 static void
 paging_init(uint64_t mem_end) {
-    uint64_t *pml4, *pte;
+    static const uint64_t sizes[] = {HPGSIZE, PGSIZE};
+    uint64_t *pml4;
+    size_t cnt[2] = {0, 0};
+    uint64_t size;
     int perm;
     pml4 = base_pml4 = palloc_get_page(PAL_ASSERT | PAL_ZERO);
 
     extern char start, _end_kernel_text;
+    uint64_t text_start = vtop(&start), text_end = vtop(&_end_kernel_text);
     // Maps physical address [0 ~ mem_end] to
     //   [LOADER_KERN_BASE ~ LOADER_KERN_BASE + mem_end].
-    for (uint64_t pa = 0; pa < mem_end; pa += PGSIZE) {
+    for (uint64_t pa = 0; pa < mem_end; pa += size) {
         uint64_t va = (uint64_t)ptov(pa);
 
-        perm = PTE_P | PTE_W;
+        size = direct_map_page_size(pa, mem_end, text_start, text_end, sizes);
+        perm = PTE_P | PTE_W | PTE_G;
         if ((uint64_t)&start <= va && va < (uint64_t)&_end_kernel_text)
             perm &= ~PTE_W;
 
-        if ((pte = pml4e_walk(pml4, va, 1)) != NULL)
-            *pte = pa | perm;
+        if (pml4_map_kernel(pml4, va, pa, size, perm))
+            cnt[size == HPGSIZE ? 0 : 1]++;
     }
+    printf("Direct map: %zu 2 MB, %zu 4 kB pages.\n", cnt[0], cnt[1]);
 
     // reload cr3
     pml4_activate(0);
+
+    /* The direct map is the same in every address space, so keep it in
+     * the TLB across CR3 loads, and tag user entries with PCIDs so a
+     * context switch does not drop them either. */
+    lcr4(rcr4() | CR4_PGE);
+    if (!no_pcid && cpu_has_pcid())
+        pml4_enable_pcid();
+    printf("PCIDs %s.\n", pcid_enabled ? "enabled" : "disabled");
 }
 
 /* Breaks the kernel command line into words and returns them as
@@ -219,11 +279,44 @@ parse_options(char **argv) {
             random_init(atoi(value));
         else if (!strcmp(name, "-mlfqs"))
             thread_mlfqs = true;
+        else if (!strcmp(name, "-no-pcid"))
+            no_pcid = true;
 #ifdef USERPROG
         else if (!strcmp(name, "-ul"))
             user_page_limit = atoi(value);
         else if (!strcmp(name, "-threads-tests"))
             thread_tests = true;
+#endif
+#ifdef VM
+        else if (!strcmp(name, "-zswap"))
+            zswap_pool_limit = atoi(value);
+        else if (!strcmp(name, "-ksm"))
+            ksm_pages_to_scan = atoi(value);
+        else if (!strcmp(name, "-fault-around")) {
+            size_t bytes = (size_t)atoi(value) * 1024;
+            if (bytes != 0 && bytes < FAULT_AROUND_MIN)
+                bytes = FAULT_AROUND_MIN;
+            if (bytes > FAULT_AROUND_MAX)
+                bytes = FAULT_AROUND_MAX;
+            fault_around_bytes = bytes;
+        } else if (!strcmp(name, "-prefault"))
+            vm_prefault_exec = true;
+        else if (!strcmp(name, "-fault-stats"))
+            faultstat_verbose = true;
+        else if (!strcmp(name, "-wmark-low"))
+            kswapd_low_wmark = atoi(value);
+        else if (!strcmp(name, "-wmark-high"))
+            kswapd_high_wmark = atoi(value);
+        else if (!strcmp(name, "-rss-limit"))
+            rss_default_limit = atoi(value);
+        else if (!strcmp(name, "-wss"))
+            wss_interval = atoi(value);
+        else if (!strcmp(name, "-thrash"))
+            loadctl_threshold = atoi(value);
+        else if (!strcmp(name, "-thrash-log"))
+            loadctl_verbose = true;
+        else if (!strcmp(name, "-no-thp"))
+            huge_enabled = false;
 #endif
         else
             PANIC("unknown option `%s' (use -h for help)", name);
@@ -323,8 +416,23 @@ usage(void) {
            "  -f                 Format file system disk during startup.\n"
            "  -rs=SEED           Set random number seed to SEED.\n"
            "  -mlfqs             Use multi-level feedback queue scheduler.\n"
+           "  -no-pcid           Never tag address spaces with PCIDs.\n"
 #ifdef USERPROG
            "  -ul=COUNT          Limit user memory to COUNT pages.\n"
+#endif
+#ifdef VM
+           "  -zswap=PAGES       Limit compressed swap pool to PAGES (0=off).\n"
+           "  -ksm=PAGES         Merge scan PAGES every 10 ticks (0=off).\n"
+           "  -fault-around=KB   Map up to KB (16-64) around file faults (0=off).\n"
+           "  -prefault          Load executables fully instead of on demand.\n"
+           "  -fault-stats       Print page fault statistics at process exit.\n"
+           "  -wmark-low=PAGES   Wake kswapd below PAGES free frames (0=off).\n"
+           "  -wmark-high=PAGES  Let kswapd reclaim up to PAGES free frames.\n"
+           "  -rss-limit=PAGES   Limit resident pages per process (0=none).\n"
+           "  -wss=TICKS         Sample working sets every TICKS (default off).\n"
+           "  -thrash=PAGES      Suspend processes above PAGES/s swapped (0=off).\n"
+           "  -thrash-log        Report each suspension for thrashing.\n"
+           "  -no-thp            Never back anonymous memory with 2 MB pages.\n"
 #endif
     );
     power_off();
@@ -358,4 +466,7 @@ print_stats(void) {
 #ifdef USERPROG
     exception_print_stats();
 #endif
+#ifdef VM
+    vm_print_stats();
+#endif
 }
@@ -1,21 +1,283 @@
 #include "threads/mmu.h"
 #include "intrinsic.h"
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/palloc.h"
 #include "threads/pte.h"
+#include "threads/synch.h"
 #include "threads/thread.h"
 #include <stdbool.h>
 #include <stddef.h>
 #include <string.h>
 
+/* Process-context identifiers.  With PCIDs, each address space tags
+ * its TLB entries with a PCID derived from the physical address of its
+ * pml4, so switching address spaces keeps the entries of the others.
+ * pcid_table records the pml4 that last used each PCID.  Activating a
+ * pml4 flushes its PCID only if another pml4 used that PCID since, or
+ * if one of its entries changed while it was not active.  PCID 0
+ * belongs to base_pml4. */
+#define PCID_CNT 4096
+
+bool pcid_enabled;
+
+static struct pcid_slot {
+    uint64_t *pml4; /* Last pml4 loaded with this PCID, or NULL. */
+    bool stale;     /* Entries of PML4 changed while it was not active. */
+} pcid_table[PCID_CNT];
+
+/* Returns the PCID of PML4, or 0 without PCIDs. */
+static unsigned
+pml4_pcid(uint64_t *pml4) {
+    if (!pcid_enabled || pml4 == base_pml4)
+        return 0;
+    return pg_no(vtop(pml4)) % (PCID_CNT - 1) + 1;
+}
+
+/* Returns the TLB batch the current thread has open on PML4, or NULL. */
+static struct mmu_gather *
+current_gather(uint64_t *pml4 UNUSED) {
+#ifdef USERPROG
+    struct mmu_gather *tlb = thread_current()->tlb;
+
+    if (tlb != NULL && tlb->pml4 == pml4)
+        return tlb;
+#endif
+    return NULL;
+}
+
+/* Invalidates the TLB entry of VA in PML4: right away if PML4 is
+ * active, otherwise the next time PML4 is activated.  Without PCIDs,
+ * an inactive address space has no TLB entries to invalidate.  Inside
+ * a TLB batch on PML4, the invalidation waits for the batch flush. */
+static void
+pml4_invalidate(uint64_t *pml4, uint64_t va) {
+    struct mmu_gather *tlb = current_gather(pml4);
+    enum intr_level old_level;
+
+    if (tlb != NULL) {
+        if (tlb->cnt < MMU_GATHER_MAX)
+            tlb->va[tlb->cnt] = va;
+        tlb->cnt++;
+        return;
+    }
+
+    old_level = intr_disable();
+    if (pml4_is_active(pml4))
+        invlpg(va);
+    else if (pcid_enabled && pcid_table[pml4_pcid(pml4)].pml4 == pml4)
+        pcid_table[pml4_pcid(pml4)].stale = true;
+    intr_set_level(old_level);
+}
+
+/* Opens TLB batch TLB on PML4 for the current thread, which must not
+ * have one open already. */
+void mmu_gather_begin(struct mmu_gather *tlb, uint64_t *pml4) {
+    tlb->pml4 = pml4;
+    tlb->cnt = 0;
+    tlb->free_list = NULL;
+    tlb->free_cnt = 0;
+#ifdef USERPROG
+    ASSERT(thread_current()->tlb == NULL);
+    thread_current()->tlb = tlb;
+#endif
+}
+
+/* Carries out the invalidations queued in TLB, then frees the pages
+ * held by it.  TLB stays open. */
+void mmu_gather_flush(struct mmu_gather *tlb) {
+    if (tlb->cnt > 0) {
+        enum intr_level old_level = intr_disable();
+
+        if (!pml4_is_active(tlb->pml4)) {
+            if (pcid_enabled && pcid_table[pml4_pcid(tlb->pml4)].pml4 == tlb->pml4)
+                pcid_table[pml4_pcid(tlb->pml4)].stale = true;
+        } else if (tlb->cnt > MMU_GATHER_MAX)
+            lcr3(rcr3() & ~CR3_NOFLUSH);
+        else
+            for (size_t i = 0; i < tlb->cnt; i++)
+                invlpg(tlb->va[i]);
+        intr_set_level(old_level);
+        tlb->cnt = 0;
+    }
+
+    while (tlb->free_list != NULL) {
+        void *page = tlb->free_list;
+
+        tlb->free_list = *(void **)page;
+        palloc_free_page(page);
+    }
+    tlb->free_cnt = 0;
+}
+
+/* Flushes and closes TLB. */
+void mmu_gather_end(struct mmu_gather *tlb) {
+    mmu_gather_flush(tlb);
+#ifdef USERPROG
+    ASSERT(thread_current()->tlb == tlb);
+    thread_current()->tlb = NULL;
+#endif
+}
+
+/* Frees PAGE, a page from palloc_get_page, once the TLB batch of the
+ * current thread is flushed, or right away if there is none. */
+void mmu_gather_free_page(void *page) {
+    struct mmu_gather *tlb = NULL;
+
+#ifdef USERPROG
+    tlb = thread_current()->tlb;
+#endif
+    if (tlb == NULL) {
+        palloc_free_page(page);
+        return;
+    }
+    *(void **)page = tlb->free_list;
+    tlb->free_list = page;
+    if (++tlb->free_cnt >= MMU_GATHER_FREE_MAX)
+        mmu_gather_flush(tlb);
+}
+
+/* Turns on PCIDs.  base_pml4 must be active. */
+void pml4_enable_pcid(void) {
+    ASSERT((rcr3() & CR3_PCID_MASK) == 0);
+
+    pcid_table[0].pml4 = base_pml4;
+    pcid_enabled = true;
+    lcr4(rcr4() | CR4_PCIDE);
+}
+
+/* Page-table pages.  Freed page tables are zeroed and kept in a pool
+ * of up to PT_POOL_MAX pages, so that fork and exec find their page
+ * tables ready instead of zeroing fresh pages; the pool's pages link
+ * through their first word.  Exiting processes hand their pml4 to the
+ * reaper thread, which frees the page tables in the background. */
+#define PT_POOL_MAX 64
+
+static void *pt_pool;         /* Zeroed pages but for the link. */
+static size_t pt_pool_cnt;    /* Pages in pt_pool. */
+
+/* A pml4 queued for the reaper, overlaid on its own page. */
+struct pml4_reap {
+    struct pml4_reap *next;   /* Next queued pml4. */
+    uint64_t pml4e;           /* The pml4's user entry. */
+    bool free_pages;          /* Free the mapped pages too? */
+};
+
+static struct pml4_reap *reap_list;  /* Pml4s waiting for the reaper. */
+static struct semaphore reap_sema;   /* Upped per queued pml4. */
+static bool reaper_started;
+
+static bool pml4_reap_pending(void);
+static void pml4_teardown(uint64_t *pml4, uint64_t pml4e, bool free_pages);
+static void pml4_queue_reap(uint64_t *pml4, bool free_pages);
+
+/* Returns a zeroed page for a page table, or a null pointer if memory
+ * is exhausted even after finishing the reaper's work. */
 static uint64_t *
-pgdir_walk(uint64_t *pdp, const uint64_t va, int create) {
+pt_alloc(void) {
+    enum intr_level old_level;
+    void *page;
+
+    do {
+        old_level = intr_disable();
+        page = pt_pool;
+        if (page != NULL) {
+            pt_pool = *(void **)page;
+            pt_pool_cnt--;
+        }
+        intr_set_level(old_level);
+        if (page != NULL) {
+            *(void **)page = NULL;
+            return page;
+        }
+        page = palloc_get_page(PAL_ZERO);
+    } while (page == NULL && pml4_reap_pending());
+    return page;
+}
+
+/* Frees page table PT into the pool, or to palloc if the pool is full. */
+static void
+pt_recycle(uint64_t *pt) {
+    enum intr_level old_level;
+
+    if (pt_pool_cnt >= PT_POOL_MAX) {
+        palloc_free_page(pt);
+        return;
+    }
+    memset(pt, 0, PGSIZE);
+
+    old_level = intr_disable();
+    *(void **)pt = pt_pool;
+    pt_pool = pt;
+    pt_pool_cnt++;
+    intr_set_level(old_level);
+}
+
+/* Replaces the 2 MB mapping in *PDE, which maps VA in PML4, by a page
+ * table of 4 kB entries that map the same frames with the same flags.
+ * Returns false if no page table could be allocated. */
+static bool
+pde_split(uint64_t *pml4, uint64_t *pde, uint64_t va) {
+    uint64_t *pt = pt_alloc();
+    uint64_t flags = *pde & PTE_FLAGS & ~PTE_PS;
+
+    if (pt == NULL)
+        return false;
+    for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++)
+        pt[i] = (PTE_ADDR(*pde) + i * PGSIZE) | flags;
+    *pde = vtop(pt) | PTE_U | PTE_W | PTE_P;
+
+    /* Invalidating any address in the 2 MB page drops its TLB entry. */
+    pml4_invalidate(pml4, va & ~(uint64_t)(HPGSIZE - 1));
+    return true;
+}
+
+/* Returns the entry of the table at level SHIFT (PDPESHIFT, PDXSHIFT or
+ * PTXSHIFT) that maps VA in PML4, creating the upper levels if CREATE
+ * is true.  Returns NULL if they do not exist and are not created. */
+static uint64_t *
+level_walk(uint64_t *pml4, const uint64_t va, uint64_t level, bool create) {
+    uint64_t *table = pml4;
+
+    for (uint64_t shift = PML4SHIFT; shift > level; shift -= 9) {
+        uint64_t *e = &table[(va >> shift) & 0x1FF];
+
+        if (!(*e & PTE_P)) {
+            uint64_t *new_page = create ? pt_alloc() : NULL;
+
+            if (new_page == NULL)
+                return NULL;
+            *e = vtop(new_page) | PTE_U | PTE_W | PTE_P;
+        }
+        table = ptov(PTE_ADDR(*e));
+    }
+    return &table[(va >> level) & 0x1FF];
+}
+
+/* Returns the page directory entry that maps VA in PML4, creating the
+ * upper levels if CREATE is true. */
+static uint64_t *
+pde_walk(uint64_t *pml4, const uint64_t va, bool create) {
+    return level_walk(pml4, va, PDXSHIFT, create);
+}
+
+/* A 2 MB page directory entry stands in for the page table entries it
+ * covers when looking them up; it is split into a page table when one
+ * of them must be created or changed. */
+static uint64_t *
+pgdir_walk(uint64_t *pml4, uint64_t *pdp, const uint64_t va, int create) {
     int idx = PDX(va);
     if (pdp) {
         uint64_t *pte = (uint64_t *)pdp[idx];
+        if (((uint64_t)pte & PTE_P) && ((uint64_t)pte & PTE_PS)) {
+            if (!create)
+                return &pdp[idx];
+            if (!pde_split(pml4, &pdp[idx], va))
+                return NULL;
+        }
         if (!((uint64_t)pte & PTE_P)) {
             if (create) {
-                uint64_t *new_page = palloc_get_page(PAL_ZERO);
+                uint64_t *new_page = pt_alloc();
                 if (new_page)
                     pdp[idx] = vtop(new_page) | PTE_U | PTE_W | PTE_P;
                 else
@@ -29,7 +291,7 @@ pgdir_walk(uint64_t *pdp, const uint64_t va, int create) {
 }
 
 static uint64_t *
-pdpe_walk(uint64_t *pdpe, const uint64_t va, int create) {
+pdpe_walk(uint64_t *pml4, uint64_t *pdpe, const uint64_t va, int create) {
     uint64_t *pte = NULL;
     int idx = PDPE(va);
     int allocated = 0;
@@ -37,7 +299,7 @@ pdpe_walk(uint64_t *pdpe, const uint64_t va, int create) {
         uint64_t *pde = (uint64_t *)pdpe[idx];
         if (!((uint64_t)pde & PTE_P)) {
             if (create) {
-                uint64_t *new_page = palloc_get_page(PAL_ZERO);
+                uint64_t *new_page = pt_alloc();
                 if (new_page) {
                     pdpe[idx] = vtop(new_page) | PTE_U | PTE_W | PTE_P;
                     allocated = 1;
@@ -46,10 +308,10 @@ pdpe_walk(uint64_t *pdpe, const uint64_t va, int create) {
             } else
                 return NULL;
         }
-        pte = pgdir_walk(ptov(PTE_ADDR(pdpe[idx])), va, create);
+        pte = pgdir_walk(pml4, ptov(PTE_ADDR(pdpe[idx])), va, create);
     }
     if (pte == NULL && allocated) {
-        palloc_free_page((void *)ptov(PTE_ADDR(pdpe[idx])));
+        pt_recycle((void *)ptov(PTE_ADDR(pdpe[idx])));
         pdpe[idx] = 0;
     }
     return pte;
@@ -70,7 +332,7 @@ pml4e_walk(uint64_t *pml4e, const uint64_t va, int create) {
         uint64_t *pdpe = (uint64_t *)pml4e[idx];
         if (!((uint64_t)pdpe & PTE_P)) {
             if (create) {
-                uint64_t *new_page = palloc_get_page(PAL_ZERO);
+                uint64_t *new_page = pt_alloc();
                 if (new_page) {
                     pml4e[idx] = vtop(new_page) | PTE_U | PTE_W | PTE_P;
                     allocated = 1;
@@ -79,10 +341,10 @@ pml4e_walk(uint64_t *pml4e, const uint64_t va, int create) {
             } else
                 return NULL;
         }
-        pte = pdpe_walk(ptov(PTE_ADDR(pml4e[idx])), va, create);
+        pte = pdpe_walk(pml4e, ptov(PTE_ADDR(pml4e[idx])), va, create);
     }
     if (pte == NULL && allocated) {
-        palloc_free_page((void *)ptov(PTE_ADDR(pml4e[idx])));
+        pt_recycle((void *)ptov(PTE_ADDR(pml4e[idx])));
         pml4e[idx] = 0;
     }
     return pte;
@@ -94,7 +356,7 @@ pml4e_walk(uint64_t *pml4e, const uint64_t va, int create) {
  * allocation fails. */
 uint64_t *
 pml4_create(void) {
-    uint64_t *pml4 = palloc_get_page(0);
+    uint64_t *pml4 = pt_alloc();
     if (pml4)
         memcpy(pml4, base_pml4, PGSIZE);
     return pml4;
@@ -122,7 +384,13 @@ pgdir_for_each(uint64_t *pdp, pte_for_each_func *func, void *aux,
                unsigned pml4_index, unsigned pdp_index) {
     for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
         uint64_t *pte = ptov((uint64_t *)pdp[i]);
-        if (((uint64_t)pte) & PTE_P)
+        if ((pdp[i] & PTE_P) && (pdp[i] & PTE_PS)) {
+            void *va = (void *)(((uint64_t)pml4_index << PML4SHIFT) |
+                                ((uint64_t)pdp_index << PDPESHIFT) |
+                                ((uint64_t)i << PDXSHIFT));
+            if (!func(&pdp[i], va, aux))
+                return false;
+        } else if (((uint64_t)pte) & PTE_P)
             if (!pt_for_each((uint64_t *)PTE_ADDR(pte), func, aux,
                              pml4_index, pdp_index, i))
                 return false;
@@ -135,7 +403,12 @@ pdp_for_each(uint64_t *pdp,
              pte_for_each_func *func, void *aux, unsigned pml4_index) {
     for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
         uint64_t *pde = ptov((uint64_t *)pdp[i]);
-        if (((uint64_t)pde) & PTE_P)
+        if ((pdp[i] & PTE_P) && (pdp[i] & PTE_PS)) {
+            void *va = (void *)(((uint64_t)pml4_index << PML4SHIFT) |
+                                ((uint64_t)i << PDPESHIFT));
+            if (!func(&pdp[i], va, aux))
+                return false;
+        } else if (((uint64_t)pde) & PTE_P)
             if (!pgdir_for_each((uint64_t *)PTE_ADDR(pde), func,
                                 aux, pml4_index, i))
                 return false;
@@ -155,33 +428,35 @@ bool pml4_for_each(uint64_t *pml4, pte_for_each_func *func, void *aux) {
 }
 
 static void
-pt_destroy(uint64_t *pt) {
-    for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
-        uint64_t *pte = ptov((uint64_t *)pt[i]);
-        if (((uint64_t)pte) & PTE_P)
-            palloc_free_page((void *)PTE_ADDR(pte));
-    }
-    palloc_free_page((void *)pt);
+pt_destroy(uint64_t *pt, bool free_pages) {
+    if (free_pages)
+        for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
+            uint64_t *pte = ptov((uint64_t *)pt[i]);
+            if (((uint64_t)pte) & PTE_P)
+                palloc_free_page((void *)PTE_ADDR(pte));
+        }
+    pt_recycle((void *)pt);
 }
 
+/* 2 MB pages are left alone; their frames belong to the VM. */
 static void
-pgdir_destroy(uint64_t *pdp) {
+pgdir_destroy(uint64_t *pdp, bool free_pages) {
     for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
         uint64_t *pte = ptov((uint64_t *)pdp[i]);
-        if (((uint64_t)pte) & PTE_P)
-            pt_destroy(PTE_ADDR(pte));
+        if ((((uint64_t)pte) & PTE_P) && !(pdp[i] & PTE_PS))
+            pt_destroy(PTE_ADDR(pte), free_pages);
     }
-    palloc_free_page((void *)pdp);
+    pt_recycle((void *)pdp);
 }
 
 static void
-pdpe_destroy(uint64_t *pdpe) {
+pdpe_destroy(uint64_t *pdpe, bool free_pages) {
     for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++) {
         uint64_t *pde = ptov((uint64_t *)pdpe[i]);
         if (((uint64_t)pde) & PTE_P)
-            pgdir_destroy((void *)PTE_ADDR(pde));
+            pgdir_destroy((void *)PTE_ADDR(pde), free_pages);
     }
-    palloc_free_page((void *)pdpe);
+    pt_recycle((void *)pdpe);
 }
 
 /* Destroys pml4e, freeing all the pages it references. */
@@ -190,17 +465,129 @@ void pml4_destroy(uint64_t *pml4) {
         return;
     ASSERT(pml4 != base_pml4);
 
+    /* A new pml4 at the same address must not find our TLB entries. */
+    if (pcid_enabled && pcid_table[pml4_pcid(pml4)].pml4 == pml4)
+        pcid_table[pml4_pcid(pml4)].pml4 = NULL;
+
+    pml4_teardown(pml4, pml4[0], true);
+}
+
+/* Frees the page tables of a dead pml4, whose only user entry, PML4E,
+ * may have been moved out of the page already, and the pages they map
+ * if FREE_PAGES is true. */
+static void
+pml4_teardown(uint64_t *pml4, uint64_t pml4e, bool free_pages) {
     /* if PML4 (vaddr) >= 1, it's kernel space by define. */
-    uint64_t *pdpe = ptov((uint64_t *)pml4[0]);
+    uint64_t *pdpe = ptov((uint64_t *)pml4e);
     if (((uint64_t)pdpe) & PTE_P)
-        pdpe_destroy((void *)PTE_ADDR(pdpe));
-    palloc_free_page((void *)pml4);
+        pdpe_destroy((void *)PTE_ADDR(pdpe), free_pages);
+    pt_recycle(pml4);
+}
+
+/* Like pml4_destroy, but leaves the work to the reaper thread, so that
+ * an exiting process need not wait for it.  PML4 must not be active. */
+void pml4_reap(uint64_t *pml4) {
+    pml4_queue_reap(pml4, true);
+}
+
+/* Like pml4_reap, but frees only the page tables, for a pml4 whose
+ * pages their owner freed already without unmapping them one by one. */
+void pml4_reap_tables(uint64_t *pml4) {
+    pml4_queue_reap(pml4, false);
+}
+
+static void
+pml4_queue_reap(uint64_t *pml4, bool free_pages) {
+    struct pml4_reap *r = (struct pml4_reap *)pml4;
+    uint64_t pml4e;
+    enum intr_level old_level;
+
+    if (pml4 == NULL)
+        return;
+    ASSERT(pml4 != base_pml4);
+    ASSERT(!pml4_is_active(pml4));
+
+    if (pcid_enabled && pcid_table[pml4_pcid(pml4)].pml4 == pml4)
+        pcid_table[pml4_pcid(pml4)].pml4 = NULL;
+    if (!reaper_started) {
+        pml4_teardown(pml4, pml4[0], free_pages);
+        return;
+    }
+
+    pml4e = pml4[0];
+    r->pml4e = pml4e;
+    r->free_pages = free_pages;
+    old_level = intr_disable();
+    r->next = reap_list;
+    reap_list = r;
+    intr_set_level(old_level);
+    sema_up(&reap_sema);
+}
+
+/* Tears down the pml4s queued for the reaper.  Returns true if there
+ * were any. */
+static bool
+pml4_reap_pending(void) {
+    struct pml4_reap *r;
+    enum intr_level old_level = intr_disable();
+
+    r = reap_list;
+    reap_list = NULL;
+    intr_set_level(old_level);
+
+    if (r == NULL)
+        return false;
+    while (r != NULL) {
+        struct pml4_reap *next = r->next;
+
+        pml4_teardown((uint64_t *)r, r->pml4e, r->free_pages);
+        r = next;
+    }
+    return true;
+}
+
+static void
+reaper(void *aux UNUSED) {
+    for (;;) {
+        sema_down(&reap_sema);
+        pml4_reap_pending();
+    }
+}
+
+/* Starts the reaper thread.  Until then, pml4_reap destroys pml4s
+ * right away. */
+void pml4_reaper_init(void) {
+    sema_init(&reap_sema, 0);
+    thread_create("reaper", PRI_DEFAULT, reaper, NULL);
+    reaper_started = true;
 }
 
 /* Loads page directory PD into the CPU's page directory base
  * register. */
 void pml4_activate(uint64_t *pml4) {
-    lcr3(vtop(pml4 ? pml4 : base_pml4));
+    uint64_t cr3;
+
+    if (pml4 == NULL)
+        pml4 = base_pml4;
+    cr3 = vtop(pml4);
+    if (pcid_enabled) {
+        struct pcid_slot *slot = &pcid_table[pml4_pcid(pml4)];
+        enum intr_level old_level = intr_disable();
+
+        cr3 |= pml4_pcid(pml4);
+        if (slot->pml4 == pml4 && !slot->stale)
+            cr3 |= CR3_NOFLUSH;
+        slot->pml4 = pml4;
+        slot->stale = false;
+        lcr3(cr3);
+        intr_set_level(old_level);
+    } else
+        lcr3(cr3);
+}
+
+/* Returns true if PML4 is the page table the CPU is using. */
+bool pml4_is_active(uint64_t *pml4) {
+    return (rcr3() & ~CR3_PCID_MASK) == vtop(pml4);
 }
 
 /* Looks up the physical address that corresponds to user virtual
@@ -213,6 +600,8 @@ pml4_get_page(uint64_t *pml4, const void *uaddr) {
 
     uint64_t *pte = pml4e_walk(pml4, (uint64_t)uaddr, 0);
 
+    if (pte && (*pte & PTE_P) && (*pte & PTE_PS))
+        return ptov(PTE_ADDR(*pte)) + ((uint64_t)uaddr & (HPGSIZE - 1));
     if (pte && (*pte & PTE_P))
         return ptov(PTE_ADDR(*pte)) + pg_ofs(uaddr);
     return NULL;
@@ -227,6 +616,13 @@ pml4_get_page(uint64_t *pml4, const void *uaddr) {
  * Returns true if successful, false if memory allocation
  * failed. */
 bool pml4_set_page(uint64_t *pml4, void *upage, void *kpage, bool rw) {
+    return pml4_map_page(pml4, upage, kpage, rw) != NULL;
+}
+
+/* Like pml4_set_page, but returns the page table entry that maps UPAGE,
+ * or a null pointer if memory allocation failed.  The entry stays at
+ * the same place until UPAGE is unmapped and its page table freed. */
+uint64_t *pml4_map_page(uint64_t *pml4, void *upage, void *kpage, bool rw) {
     ASSERT(pg_ofs(upage) == 0);
     ASSERT(pg_ofs(kpage) == 0);
     ASSERT(is_user_vaddr(upage));
@@ -234,9 +630,14 @@ bool pml4_set_page(uint64_t *pml4, void *upage, void *kpage, bool rw) {
 
     uint64_t *pte = pml4e_walk(pml4, (uint64_t)upage, 1);
 
-    if (pte)
+    if (pte) {
+        bool was_present = (*pte & PTE_P) != 0;
+
         *pte = vtop(kpage) | PTE_P | (rw ? PTE_W : 0) | PTE_U;
-    return pte != NULL;
+        if (was_present)
+            pml4_invalidate(pml4, (uint64_t)upage);
+    }
+    return pte;
 }
 
 /* Marks user virtual page UPAGE "not present" in page
@@ -249,36 +650,72 @@ void pml4_clear_page(uint64_t *pml4, void *upage) {
     ASSERT(is_user_vaddr(upage));
 
     pte = pml4e_walk(pml4, (uint64_t)upage, false);
+    if (pte != NULL && (*pte & PTE_P) && (*pte & PTE_PS))
+        pte = pml4e_walk(pml4, (uint64_t)upage, true);
+
+    if (pte != NULL)
+        pte_clear(pml4, pte, upage);
+}
 
-    if (pte != NULL && (*pte & PTE_P) != 0) {
+/* Marks PTE, the entry that maps UPAGE in PML4, not present.  PTE must
+ * map a 4 kB page. */
+void pte_clear(uint64_t *pml4, uint64_t *pte, const void *upage) {
+    ASSERT(!(*pte & PTE_PS));
+
+    if ((*pte & PTE_P) != 0) {
         *pte &= ~PTE_P;
-        if (rcr3() == vtop(pml4))
-            invlpg((uint64_t)upage);
+        pml4_invalidate(pml4, (uint64_t)upage);
     }
 }
 
+/* Sets the dirty bit to DIRTY in PTE, the entry that maps VPAGE in
+ * PML4. */
+void pte_set_dirty(uint64_t *pml4, uint64_t *pte, const void *vpage, bool dirty) {
+    if (dirty)
+        *pte |= PTE_D;
+    else
+        *pte &= ~(uint32_t)PTE_D;
+
+    pml4_invalidate(pml4, (uint64_t)vpage);
+}
+
+/* Sets the accessed bit to ACCESSED in PTE, the entry that maps VPAGE
+ * in PML4.  A TLB entry left over from before a clear only keeps the
+ * CPU from setting the bit again until the entry is dropped, so an
+ * inactive address space is not made to lose its PCID for it. */
+void pte_set_accessed(uint64_t *pml4, uint64_t *pte, const void *vpage, bool accessed) {
+    enum intr_level old_level;
+
+    if (accessed)
+        *pte |= PTE_A;
+    else
+        *pte &= ~(uint32_t)PTE_A;
+
+    if (current_gather(pml4) != NULL) {
+        pml4_invalidate(pml4, (uint64_t)vpage);
+        return;
+    }
+    old_level = intr_disable();
+    if (pml4_is_active(pml4))
+        invlpg((uint64_t)vpage);
+    intr_set_level(old_level);
+}
+
 /* Returns true if the PTE for virtual page VPAGE in PML4 is dirty,
  * that is, if the page has been modified since the PTE was
  * installed.
  * Returns false if PML4 contains no PTE for VPAGE. */
 bool pml4_is_dirty(uint64_t *pml4, const void *vpage) {
     uint64_t *pte = pml4e_walk(pml4, (uint64_t)vpage, false);
-    return pte != NULL && (*pte & PTE_D) != 0;
+    return pte_is_dirty(pte);
 }
 
 /* Set the dirty bit to DIRTY in the PTE for virtual page VPAGE
  * in PML4. */
 void pml4_set_dirty(uint64_t *pml4, const void *vpage, bool dirty) {
     uint64_t *pte = pml4e_walk(pml4, (uint64_t)vpage, false);
-    if (pte) {
-        if (dirty)
-            *pte |= PTE_D;
-        else
-            *pte &= ~(uint32_t)PTE_D;
-
-        if (rcr3() == vtop(pml4))
-            invlpg((uint64_t)vpage);
-    }
+    if (pte)
+        pte_set_dirty(pml4, pte, vpage, dirty);
 }
 
 /* Returns true if the PTE for virtual page VPAGE in PML4 has been
@@ -287,20 +724,111 @@ void pml4_set_dirty(uint64_t *pml4, const void *vpage, bool dirty) {
  * PML4 contains no PTE for VPAGE. */
 bool pml4_is_accessed(uint64_t *pml4, const void *vpage) {
     uint64_t *pte = pml4e_walk(pml4, (uint64_t)vpage, false);
-    return pte != NULL && (*pte & PTE_A) != 0;
+    return pte_is_accessed(pte);
 }
 
 /* Sets the accessed bit to ACCESSED in the PTE for virtual page
    VPAGE in PD. */
 void pml4_set_accessed(uint64_t *pml4, const void *vpage, bool accessed) {
     uint64_t *pte = pml4e_walk(pml4, (uint64_t)vpage, false);
-    if (pte) {
-        if (accessed)
-            *pte |= PTE_A;
-        else
-            *pte &= ~(uint32_t)PTE_A;
+    if (pte)
+        pte_set_accessed(pml4, pte, vpage, accessed);
+}
+
+/* Maps the 2 MB of user virtual memory at UPAGE in PML4 to the
+ * physically contiguous frames at KPAGE with a single page directory
+ * entry.  Both addresses must be 2 MB aligned, and none of the pages
+ * in the range may be mapped.  Returns false if memory allocation
+ * failed or the range is in use. */
+bool pml4_set_huge_page(uint64_t *pml4, void *upage, void *kpage, bool rw) {
+    uint64_t *pde;
+
+    ASSERT(((uint64_t)upage & (HPGSIZE - 1)) == 0);
+    ASSERT((vtop(kpage) & (HPGSIZE - 1)) == 0);
+    ASSERT(is_user_vaddr((uint8_t *)upage + HPGSIZE - 1));
+    ASSERT(pml4 != base_pml4);
 
-        if (rcr3() == vtop(pml4))
-            invlpg((uint64_t)vpage);
+    pde = pde_walk(pml4, (uint64_t)upage, true);
+    if (pde == NULL)
+        return false;
+
+    /* A page table left from earlier mappings may be dropped once
+     * nothing in it is present any more. */
+    if ((*pde & PTE_P) && !(*pde & PTE_PS)) {
+        uint64_t *pt = ptov(PTE_ADDR(*pde));
+
+        for (unsigned i = 0; i < PGSIZE / sizeof(uint64_t *); i++)
+            if (pt[i] & PTE_P)
+                return false;
+        *pde = 0;
+        pml4_invalidate(pml4, (uint64_t)upage);
+        pt_recycle(pt);
+    }
+    if (*pde & PTE_P)
+        return false;
+
+    *pde = vtop(kpage) | PTE_P | PTE_PS | (rw ? PTE_W : 0) | PTE_U;
+    return true;
+}
+
+/* Frees the page tables of PML4 that only map pages in [START, END)
+ * and have no present entry left.  The page tables go through
+ * mmu_gather_free_page. */
+void pml4_free_tables(uint64_t *pml4, void *start, void *end) {
+    uint64_t va = ((uint64_t)start + HPGSIZE - 1) & ~(HPGSIZE - 1);
+
+    for (; va + HPGSIZE <= (uint64_t)end; va += HPGSIZE) {
+        uint64_t *pde = pde_walk(pml4, va, false);
+        uint64_t *pt;
+        unsigned i;
+
+        if (pde == NULL || !(*pde & PTE_P) || (*pde & PTE_PS))
+            continue;
+        pt = ptov(PTE_ADDR(*pde));
+        for (i = 0; i < PGSIZE / sizeof(uint64_t *); i++)
+            if (pt[i] & PTE_P)
+                break;
+        if (i < PGSIZE / sizeof(uint64_t *))
+            continue;
+
+        *pde = 0;
+        pml4_invalidate(pml4, va);
+        mmu_gather_free_page(pt);
     }
 }
+
+/* Returns true if UPAGE is mapped by a 2 MB page in PML4. */
+bool pml4_is_huge(uint64_t *pml4, const void *upage) {
+    uint64_t *pde = pde_walk(pml4, (uint64_t)upage, false);
+    return pde != NULL && (*pde & PTE_P) && (*pde & PTE_PS);
+}
+
+/* Splits the 2 MB page that maps UPAGE in PML4, if there is one, into
+ * 4 kB pages with the same frames and flags.  Returns false if no page
+ * table could be allocated. */
+bool pml4_split_huge(uint64_t *pml4, const void *upage) {
+    uint64_t *pde = pde_walk(pml4, (uint64_t)upage, false);
+
+    if (pde == NULL || !(*pde & PTE_P) || !(*pde & PTE_PS))
+        return true;
+    return pde_split(pml4, pde, (uint64_t)upage);
+}
+
+/* Maps the SIZE bytes of physical memory at PA to kernel virtual
+ * address VA in PML4 with a single entry carrying PERM.  SIZE is
+ * PGSIZE or HPGSIZE, and VA and PA must be aligned to it.
+ * Used to build the kernel's direct map.  Returns false if memory
+ * allocation failed. */
+bool pml4_map_kernel(uint64_t *pml4, uint64_t va, uint64_t pa, uint64_t size, uint64_t perm) {
+    uint64_t level = size == HPGSIZE ? PDXSHIFT : PTXSHIFT;
+    uint64_t *e;
+
+    ASSERT(size == PGSIZE || size == HPGSIZE);
+    ASSERT(va % size == 0 && pa % size == 0);
+
+    e = level_walk(pml4, va, level, true);
+    if (e == NULL)
+        return false;
+    *e = pa | perm | (size != PGSIZE ? PTE_PS : 0);
+    return true;
+}
@@ -1,5 +1,6 @@
 #include "threads/palloc.h"
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/loader.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -31,6 +32,7 @@ struct pool {
     struct lock lock;        /* Mutual exclusion. */
     struct bitmap *used_map; /* Bitmap of free pages. */
     uint8_t *base;           /* Base of pool. */
+    size_t free_cnt;         /* Number of free pages. */
 };
 
 /* Two pools: one for kernel data, one for user pages. */
@@ -234,6 +236,8 @@ populate_pools(struct area *base_mem, struct area *ext_mem) {
             }
         }
     }
+    kernel_pool.free_cnt = bitmap_count(kernel_pool.used_map, 0, bitmap_size(kernel_pool.used_map), false);
+    user_pool.free_cnt = bitmap_count(user_pool.used_map, 0, bitmap_size(user_pool.used_map), false);
 }
 
 /* Initializes the page allocator and get the memory size */
@@ -265,11 +269,19 @@ void *
 palloc_get_multiple(enum palloc_flags flags, size_t page_cnt) {
     struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
 
+    enum intr_level old_level;
+
     lock_acquire(&pool->lock);
     size_t page_idx = bitmap_scan_and_flip(pool->used_map, 0, page_cnt, false);
     lock_release(&pool->lock);
     void *pages;
 
+    if (page_idx != BITMAP_ERROR) {
+        old_level = intr_disable();
+        pool->free_cnt -= page_cnt;
+        intr_set_level(old_level);
+    }
+
     if (page_idx != BITMAP_ERROR)
         pages = pool->base + PGSIZE * page_idx;
     else
@@ -286,6 +298,44 @@ palloc_get_multiple(enum palloc_flags flags, size_t page_cnt) {
     return pages;
 }
 
+/* Obtains a group of PAGE_CNT contiguous free pages whose physical
+   address is a multiple of ALIGN_CNT pages, which must be a power of
+   two.  FLAGS are as for palloc_get_multiple().  Returns a null
+   pointer if no suitably aligned run is free. */
+void *
+palloc_get_aligned(enum palloc_flags flags, size_t page_cnt, size_t align_cnt) {
+    struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
+    size_t pool_size = bitmap_size(pool->used_map);
+    size_t page_idx = BITMAP_ERROR;
+    enum intr_level old_level;
+    void *pages = NULL;
+
+    ASSERT(align_cnt != 0 && (align_cnt & (align_cnt - 1)) == 0);
+
+    lock_acquire(&pool->lock);
+    for (size_t idx = (align_cnt - pg_no(vtop(pool->base)) % align_cnt) % align_cnt;
+         idx + page_cnt <= pool_size; idx += align_cnt)
+        if (!bitmap_contains(pool->used_map, idx, page_cnt, true)) {
+            bitmap_set_multiple(pool->used_map, idx, page_cnt, true);
+            page_idx = idx;
+            break;
+        }
+    lock_release(&pool->lock);
+
+    if (page_idx != BITMAP_ERROR) {
+        old_level = intr_disable();
+        pool->free_cnt -= page_cnt;
+        intr_set_level(old_level);
+
+        pages = pool->base + PGSIZE * page_idx;
+        if (flags & PAL_ZERO)
+            memset(pages, 0, PGSIZE * page_cnt);
+    } else if (flags & PAL_ASSERT)
+        PANIC("palloc_get: out of pages");
+
+    return pages;
+}
+
 /* Obtains a single free page and returns its kernel virtual
    address.
    If PAL_USER is set, the page is obtained from the user pool,
@@ -302,6 +352,7 @@ palloc_get_page(enum palloc_flags flags) {
 void palloc_free_multiple(void *pages, size_t page_cnt) {
     struct pool *pool;
     size_t page_idx;
+    enum intr_level old_level;
 
     ASSERT(pg_ofs(pages) == 0);
     if (pages == NULL || page_cnt == 0)
@@ -321,6 +372,11 @@ void palloc_free_multiple(void *pages, size_t page_cnt) {
 #endif
     ASSERT(bitmap_all(pool->used_map, page_idx, page_cnt));
     bitmap_set_multiple(pool->used_map, page_idx, page_cnt, false);
+
+    /* Pages are also freed from the scheduler, so no lock here. */
+    old_level = intr_disable();
+    pool->free_cnt += page_cnt;
+    intr_set_level(old_level);
 }
 
 /* Frees the page at PAGE. */
@@ -328,6 +384,19 @@ void palloc_free_page(void *page) {
     palloc_free_multiple(page, 1);
 }
 
+/* Stores the address of the first page of the user pool in *BASE and
+   the number of pages it spans in *PAGE_CNT.  Some of these pages may
+   be unusable holes that are never handed out. */
+void palloc_user_range(void **base, size_t *page_cnt) {
+    *base = user_pool.base;
+    *page_cnt = bitmap_size(user_pool.used_map);
+}
+
+/* Returns the number of free pages in the user pool. */
+size_t palloc_user_free_cnt(void) {
+    return user_pool.free_cnt;
+}
+
 /* Initializes pool P as starting at START and ending at END */
 static void
 init_pool(struct pool *p, void **bm_base, uint64_t start, uint64_t end) {
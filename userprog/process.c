@@ -23,12 +23,19 @@
 #include <string.h>
 #ifdef VM
 #include "vm/vm.h"
+#include "vm/faultstat.h"
+#include "vm/heap.h"
+#include "vm/loadctl.h"
+#include "vm/rss.h"
 #endif
 
 static void process_cleanup(void);
 static bool load(const char *file_name, struct intr_frame *if_);
+static bool load_image(const char *path, uint64_t argc, char *argv[], struct intr_frame *if_);
 static void initd(void *f_name);
 static void __do_fork(void *);
+static void __do_spawn(void *);
+static struct file_descriptor *lookup_fd(struct thread *owner, int fd, struct file_descriptor **root);
 extern struct lock file_lock;
 /* General process initializer for initd and other process. */
 static void
@@ -67,6 +74,7 @@ static void
 initd(void *f_name) {
 #ifdef VM
     supplemental_page_table_init(&thread_current()->spt);
+    thread_current()->rss_limit = rss_default_limit;
 #endif
 
     process_init();
@@ -84,6 +92,28 @@ tid_t process_fork(const char *name, struct intr_frame *if_ UNUSED) {
                          PRI_DEFAULT, __do_fork, thread_current());
 }
 
+/* Starts the executable named in ARGS as a child of the current process,
+ * without copying the current address space the way fork() does.  The
+ * child starts with the standard descriptors plus those ARGS hands over.
+ * Takes ownership of ARGS.  Returns the child's thread id, or TID_ERROR
+ * if it cannot be created or its executable cannot be loaded. */
+tid_t process_spawn(struct spawn_args *args) {
+    struct thread *curr = thread_current();
+    struct thread *child;
+    tid_t tid;
+
+    args->parent = curr;
+    tid = thread_create(args->argv[0], PRI_DEFAULT, __do_spawn, args);
+    if (tid == TID_ERROR) {
+        palloc_free_page(args);
+        return TID_ERROR;
+    }
+
+    child = get_child(tid);
+    sema_down(&curr->fork_sema);
+    return child->tid;
+}
+
 #ifndef VM
 /* Duplicate the parent's address space by passing this function to the
  * pml4_for_each. This is only for the project 2. */
@@ -154,6 +184,7 @@ __do_fork(void *aux) {
 
     process_activate(current);
 #ifdef VM
+    current->rss_limit = parent->rss_limit;
     supplemental_page_table_init(&current->spt);
     if (!supplemental_page_table_copy(&current->spt, &parent->spt))
         goto error;
@@ -217,6 +248,85 @@ error:
     exit(TID_ERROR);
 }
 
+/* Gives the current thread the descriptors of PARENT that ARGS lists,
+ * under their new numbers.  A number the child already has, such as a
+ * standard descriptor, is replaced. */
+static bool
+spawn_fds(struct spawn_args *args, struct thread *parent) {
+    struct thread *current = thread_current();
+
+    for (size_t i = 0; i < args->action_cnt; i++) {
+        struct spawn_fd_action *action = &args->actions[i];
+        struct file_descriptor *root;
+        struct file_descriptor *parent_fd = lookup_fd(parent, action->fd, &root);
+        struct file_descriptor *child_fd;
+
+        if (parent_fd == NULL || action->child_fd < 0)
+            return false;
+
+        child_fd = lookup_fd(current, action->child_fd, &root);
+        if (child_fd != NULL) {
+            list_remove(&child_fd->elem);
+            file_close(child_fd->file);
+            free(child_fd);
+        }
+
+        child_fd = calloc(1, sizeof *child_fd);
+        if (child_fd == NULL)
+            return false;
+        duplicate_fd(child_fd, parent_fd, action->child_fd);
+        if (parent_fd->file) {
+            lock_acquire(&file_lock);
+            child_fd->file = file_duplicate(parent_fd->file);
+            lock_release(&file_lock);
+            if (child_fd->file == NULL) {
+                free(child_fd);
+                return false;
+            }
+        }
+        list_push_back(&current->fd_list, &child_fd->elem);
+    }
+    return true;
+}
+
+/* A thread function that builds a spawned process straight from its
+ * executable.  The parent waits on its fork_sema until the load is done,
+ * so its descriptors can be read here as in __do_fork(). */
+static void
+__do_spawn(void *aux) {
+    struct spawn_args *args = aux;
+    struct thread *parent = args->parent;
+    struct thread *current = thread_current();
+    struct intr_frame if_;
+
+    memset(&if_, 0, sizeof if_);
+    if_.ds = if_.es = if_.ss = SEL_UDSEG;
+    if_.cs = SEL_UCSEG;
+    if_.eflags = FLAG_IF | FLAG_MBS;
+
+#ifdef VM
+    current->rss_limit = parent->rss_limit;
+    supplemental_page_table_init(&current->spt);
+#endif
+    process_init();
+
+    if (fd_list_init() == -1 || !spawn_fds(args, parent))
+        goto error;
+    if (!load_image(args->path, args->argc, args->argv, &if_))
+        goto error;
+
+    palloc_free_page(args);
+    sema_up(&parent->fork_sema);
+    do_iret(&if_);
+    NOT_REACHED();
+
+error:
+    palloc_free_page(args);
+    current->tid = TID_ERROR;
+    sema_up(&parent->fork_sema);
+    exit(TID_ERROR);
+}
+
 /* Switch the current execution context to the f_name.
  * Returns -1 on fail. */
 int process_exec(void *f_name) {
@@ -314,7 +424,14 @@ void process_exit(void) {
      * TODO: project2/process_termination.html).
      * TODO: We recommend you to implement process resource cleanup here. */
 
+#ifdef VM
+    faultstat_exit(curr);
+#endif
     process_cleanup();
+#ifdef VM
+    loadctl_exit(curr);
+    shm_exit(curr);
+#endif
 
     if (!list_empty(&curr->fd_list)) {
         for (e = list_begin(&curr->fd_list); e != list_end(&curr->fd_list);) {
@@ -371,7 +488,12 @@ process_cleanup(void) {
          * that's been freed (and cleared). */
         curr->pml4 = NULL;
         pml4_activate(NULL);
-        pml4_destroy(pml4);
+#ifdef VM
+        /* The VM freed the user pages already. */
+        pml4_reap_tables(pml4);
+#else
+        pml4_reap(pml4);
+#endif
     }
 }
 
@@ -450,16 +572,24 @@ static bool load_segment(struct file *file, off_t ofs, uint8_t *upage,
  * Returns true if successful, false otherwise. */
 static bool
 load(const char *file_name, struct intr_frame *if_) {
+    uint64_t argc;
+    char *argv[128];
+
+    argument_parsing(file_name, &argc, argv);
+    return load_image(file_name, argc, argv, if_);
+}
+
+/* Loads the ELF executable PATH into the current thread and passes it
+ * the ARGC arguments in ARGV, as load() does for a command line. */
+static bool
+load_image(const char *path, uint64_t argc, char *argv[], struct intr_frame *if_) {
     struct thread *t = thread_current();
     struct ELF ehdr;
     struct file *file = NULL;
     off_t file_ofs;
     bool success = false;
     int i;
-    uint64_t argc;
-    char *argv[128];
-
-    argument_parsing(file_name, &argc, argv);
+    uint64_t image_end = 0;
 
     /* Allocate and activate page directory. */
     t->pml4 = pml4_create();
@@ -469,10 +599,10 @@ load(const char *file_name, struct intr_frame *if_) {
 
     /* Open executable file. */
     lock_acquire(&file_lock);
-    file = filesys_open(file_name);
+    file = filesys_open(path);
     lock_release(&file_lock);
     if (file == NULL) {
-        printf("load: %s: open failed\n", file_name);
+        printf("load: %s: open failed\n", path);
         goto done;
     }
     file_deny_write(file);
@@ -480,7 +610,7 @@ load(const char *file_name, struct intr_frame *if_) {
     /* Read and verify executable header. */
     if (file_read(file, &ehdr, sizeof ehdr) != sizeof ehdr || memcmp(ehdr.e_ident, "\177ELF\2\1\1", 7) || ehdr.e_type != 2 || ehdr.e_machine != 0x3E // amd64
         || ehdr.e_version != 1 || ehdr.e_phentsize != sizeof(struct Phdr) || ehdr.e_phnum > 1024) {
-        printf("load: %s: error loading executable\n", file_name);
+        printf("load: %s: error loading executable\n", path);
         goto done;
     }
 
@@ -529,6 +659,12 @@ load(const char *file_name, struct intr_frame *if_) {
                 if (!load_segment(file, file_page, (void *)mem_page,
                                   read_bytes, zero_bytes, writable))
                     goto done;
+                if (phdr.p_vaddr + phdr.p_memsz > image_end)
+                    image_end = phdr.p_vaddr + phdr.p_memsz;
+#ifdef VM
+                if (vm_prefault_exec)
+                    vm_populate((void *)mem_page, read_bytes + zero_bytes);
+#endif
             } else
                 goto done;
             break;
@@ -538,6 +674,9 @@ load(const char *file_name, struct intr_frame *if_) {
     /* Set up stack. */
     if (!setup_stack(if_))
         goto done;
+#ifdef VM
+    heap_set_start((void *)image_end);
+#endif
 
     /* Start address. */
     if_->rip = ehdr.e_entry;
@@ -717,11 +856,19 @@ bool lazy_load_segment(struct page *page, void *aux) {
     off_t offset = seg_aux->offset;
     size_t page_read_bytes = seg_aux->page_read_bytes;
     size_t page_zero_bytes = seg_aux->page_zero_bytes;
-
+    bool held = lock_held_by_current_thread(&file_lock);
+    off_t bytes_read;
+
+    /* Load this page, after the runs that exited processes queued for
+     * writebackd, which may hold newer contents. */
+    if (!held)
+        lock_acquire(&file_lock);
+    file_writeback_flush();
     file_seek(file, offset);
-    /* Load this page. */
-    if (file_read(file, page->frame->kva, page_read_bytes) != (int)page_read_bytes)
-
+    bytes_read = file_read(file, page->frame->kva, page_read_bytes);
+    if (!held)
+        lock_release(&file_lock);
+    if (bytes_read != (int)page_read_bytes)
         return false;
 
     memset(page->frame->kva + page_read_bytes, 0, page_zero_bytes);
@@ -837,13 +984,19 @@ void duplicate_fd(struct file_descriptor *new_fd, struct file_descriptor *old_fd
 }
 
 struct file_descriptor *get_fd(int fd, struct file_descriptor **root) {
-    struct thread *curr = thread_current();
+    return lookup_fd(thread_current(), fd, root);
+}
+
+/* Finds descriptor FD of thread OWNER and stores the descriptor it is a
+ * duplicate of, or itself, in *ROOT. */
+static struct file_descriptor *
+lookup_fd(struct thread *owner, int fd, struct file_descriptor **root) {
     struct file_descriptor *t;
     struct file_descriptor *dt;
     struct list_elem *e;
     struct list_elem *ed;
 
-    for (e = list_begin(&curr->fd_list); e != list_end(&curr->fd_list); e = list_next(e)) {
+    for (e = list_begin(&owner->fd_list); e != list_end(&owner->fd_list); e = list_next(e)) {
         t = list_entry(e, struct file_descriptor, elem);
         if (t->fd == fd) {
             *root = t;
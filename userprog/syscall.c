@@ -12,6 +12,12 @@
 #include "threads/thread.h"
 #include "userprog/gdt.h"
 #include "userprog/process.h"
+#include "vm/faultstat.h"
+#include "vm/heap.h"
+#include "vm/madvise.h"
+#include "vm/rss.h"
+#include "vm/shm.h"
+#include <mman.h>
 #include <stdio.h>
 #include <syscall-nr.h>
 
@@ -22,6 +28,7 @@ void halt(void) NO_RETURN;
 void exit(int status) NO_RETURN;
 pid_t fork(const char *thread_name, struct intr_frame *f);
 int exec(const char *file);
+pid_t spawn(const char *file, char **argv, const struct spawn_fd_action *actions);
 int wait(pid_t pid);
 bool create(const char *file, unsigned initial_size);
 bool remove(const char *file);
@@ -39,6 +46,12 @@ void check_buffer(uint64_t *buffer);
 
 void *mmap(void *addr, size_t length, int writable, int fd, off_t offset);
 void munmap(void *addr);
+int madvise(void *addr, size_t length, int advice);
+int msync(void *addr, size_t length);
+int fault_stats(struct fault_stats *stats, bool global);
+int rss_limit(size_t pages);
+int mem_usage(struct mem_usage *usage);
+void *sbrk(intptr_t increment);
 /* lock for access file_sys code */
 struct lock file_lock;
 
@@ -129,6 +142,36 @@ void syscall_handler(struct intr_frame *f UNUSED) {
     case SYS_MUNMAP:
         munmap(f->R.rdi);
         break;
+    case SYS_MADVISE:
+        f->R.rax = madvise(f->R.rdi, f->R.rsi, f->R.rdx);
+        break;
+    case SYS_FAULT_STATS:
+        f->R.rax = fault_stats(f->R.rdi, f->R.rsi);
+        break;
+    case SYS_RSS_LIMIT:
+        f->R.rax = rss_limit(f->R.rdi);
+        break;
+    case SYS_MEM_USAGE:
+        f->R.rax = mem_usage(f->R.rdi);
+        break;
+    case SYS_SBRK:
+        f->R.rax = sbrk(f->R.rdi);
+        break;
+    case SYS_SPAWN:
+        f->R.rax = spawn(f->R.rdi, f->R.rsi, f->R.rdx);
+        break;
+    case SYS_SHM_CREATE:
+        f->R.rax = shm_create(f->R.rdi);
+        break;
+    case SYS_SHM_ATTACH:
+        f->R.rax = shm_attach(f->R.rdi, f->R.rsi, f->R.rdx);
+        break;
+    case SYS_SHM_DETACH:
+        f->R.rax = shm_detach(f->R.rdi);
+        break;
+    case SYS_MSYNC:
+        f->R.rax = msync(f->R.rdi, f->R.rsi);
+        break;
     default:
         break;
     }
@@ -159,6 +202,70 @@ int exec(const char *file) {
         exit(-1);
 }
 
+/* Copies user string S into the strings of ARGS.  Returns the copy, or
+ * NULL if ARGS has no room left. */
+static char *
+spawn_copy_string(struct spawn_args *args, const char *s) {
+    size_t room = PGSIZE - sizeof *args - args->used;
+    size_t len;
+    char *copy;
+
+    check_addr((uint64_t *)s);
+    len = strnlen(s, room);
+    if (len == room)
+        return NULL;
+    copy = args->strings + args->used;
+    memcpy(copy, s, len + 1);
+    args->used += len + 1;
+    return copy;
+}
+
+pid_t spawn(const char *file, char **argv, const struct spawn_fd_action *actions) {
+    struct spawn_args *args;
+
+    check_addr((uint64_t *)file);
+
+    args = palloc_get_page(PAL_ZERO);
+    if (args == NULL)
+        return TID_ERROR;
+
+    args->path = spawn_copy_string(args, file);
+    if (args->path == NULL)
+        goto error;
+
+    if (argv == NULL)
+        args->argv[args->argc++] = args->path;
+    else
+        for (;; args->argc++) {
+            check_addr((uint64_t *)&argv[args->argc]);
+            if (argv[args->argc] == NULL)
+                break;
+            if (args->argc == SPAWN_ARGV_MAX)
+                goto error;
+            args->argv[args->argc] = spawn_copy_string(args, argv[args->argc]);
+            if (args->argv[args->argc] == NULL)
+                goto error;
+        }
+    if (args->argc == 0)
+        goto error;
+
+    if (actions != NULL)
+        for (;; args->action_cnt++) {
+            check_addr((uint64_t *)&actions[args->action_cnt]);
+            if (actions[args->action_cnt].fd == -1)
+                break;
+            if (args->action_cnt == SPAWN_FD_MAX)
+                goto error;
+            args->actions[args->action_cnt] = actions[args->action_cnt];
+        }
+
+    return process_spawn(args);
+
+error:
+    palloc_free_page(args);
+    return TID_ERROR;
+}
+
 int open(const char *file) {
     struct thread *curr = thread_current();
     struct file_descriptor *fd;
@@ -308,6 +415,7 @@ int read(int fd, void *buffer, unsigned length) {
             return input_getc();
         if (find_fd->file) {
             lock_acquire(&file_lock);
+            file_writeback_flush();
             result = file_read(find_fd->file, buffer, length);
             lock_release(&file_lock);
         }
@@ -331,6 +439,7 @@ int write(int fd, const void *buffer, unsigned length) {
         }
         if (find_fd->file) {
             lock_acquire(&file_lock);
+            file_writeback_flush();
             result = file_write(find_fd->file, buffer, length);
             lock_release(&file_lock);
         }
@@ -396,7 +505,17 @@ void check_buffer(uint64_t *buffer) {
 
 void *mmap(void *addr, size_t length, int writable, int fd, off_t offset) {
     struct file_descriptor *root_fd;
-    struct file *file = get_fd(fd, &root_fd)->file;
+    struct file *file;
+
+    if (writable & MAP_ANON) {
+        if (fd != -1 || offset != 0)
+            return NULL;
+        if (addr != NULL && (!is_user_vaddr(addr) || !is_user_vaddr(addr + length)))
+            return NULL;
+        return do_mmap_anon(addr, length, writable);
+    }
+
+    file = get_fd(fd, &root_fd)->file;
 
     if (pg_round_down(offset) != offset)
         return NULL;
@@ -417,5 +536,34 @@ void *mmap(void *addr, size_t length, int writable, int fd, off_t offset) {
 }
 
 void munmap(void *addr) {
-    do_munmap(addr);
+    if (!do_munmap_anon(addr))
+        do_munmap(addr);
+}
+
+int madvise(void *addr, size_t length, int advice) {
+    return do_madvise(addr, length, advice);
+}
+
+int msync(void *addr, size_t length) {
+    return do_msync(addr, length);
+}
+
+int fault_stats(struct fault_stats *stats, bool global) {
+    if (stats == NULL || !is_user_vaddr(stats) || !is_user_vaddr(stats + 1))
+        return -1;
+    return faultstat_query(stats, global);
+}
+
+int rss_limit(size_t pages) {
+    return rss_set_limit(pages);
+}
+
+int mem_usage(struct mem_usage *usage) {
+    if (usage == NULL || !is_user_vaddr(usage) || !is_user_vaddr(usage + 1))
+        return -1;
+    return rss_query(usage);
+}
+
+void *sbrk(intptr_t increment) {
+    return do_sbrk(increment);
 }
\ No newline at end of file
@@ -2,18 +2,33 @@
 
 #include "devices/disk.h"
 #include "vm/vm.h"
+#include "vm/hugepage.h"
+#include "vm/rss.h"
+#include "vm/zswap.h"
 #include "bitmap.h"
+#include "threads/malloc.h"
 #include "threads/mmu.h"
 #include "threads/vaddr.h"
 #include "threads/synch.h"
+#include "userprog/process.h"
+#include <mman.h>
+#include <string.h>
+
+/* Number of disk sectors that hold one page. */
+#define SECTORS_PER_PAGE (PGSIZE / DISK_SECTOR_SIZE)
 
 struct bitmap *swap_table;
 struct lock swap_table_lock;
+/* Page that currently owns each swap slot, used for readahead. */
+static struct page **swap_slot_page;
+long long anon_swap_ins;
+long long anon_swap_outs;
 /* DO NOT MODIFY BELOW LINE */
 static struct disk *swap_disk;
 static bool anon_swap_in(struct page *page, void *kva);
 static bool anon_swap_out(struct page *page);
 static void anon_destroy(struct page *page);
+static void anon_swap_readahead(struct page *page, size_t slot_no);
 
 /* DO NOT MODIFY this struct */
 static const struct page_operations anon_ops = {
@@ -28,15 +43,29 @@ void vm_anon_init(void) {
 
     lock_init(&swap_table_lock);
     swap_disk = disk_get(1, 1);
-    size_t swap_size = disk_size(swap_disk) / (PGSIZE / DISK_SECTOR_SIZE);
+    size_t swap_size = disk_size(swap_disk) / SECTORS_PER_PAGE;
     swap_table = bitmap_create(swap_size);
+    swap_slot_page = calloc(swap_size, sizeof *swap_slot_page);
+    zswap_init();
 }
 
 /* Initialize the file mapping */
 bool anon_initializer(struct page *page, enum vm_type type, void *kva) {
+    /* Fetch first, the anon_page overlaps the uninit_page. */
+    struct load_aux *origin = page->uninit.init == lazy_load_segment ? page->uninit.aux : NULL;
 
     page->operations = &anon_ops;
     struct anon_page *anon_page = &page->anon;
+    anon_page->zswap = NULL;
+    anon_page->origin = origin;
+    return true;
+}
+
+/* Releases swap slot SLOT_NO.  Caller must hold swap_table_lock. */
+static void
+swap_slot_release(size_t slot_no) {
+    bitmap_set(swap_table, slot_no, false);
+    swap_slot_page[slot_no] = NULL;
 }
 
 /* Swap in the page by read contents from the swap disk. */
@@ -44,48 +73,225 @@ static bool anon_swap_in(struct page *page, void *kva) {
 
     size_t slot_no = page->slot_no;
 
+    if (zswap_load(page->anon.zswap, kva)) {
+        page->anon.zswap = NULL;
+        anon_swap_ins++;
+        return true;
+    }
+
+    /* Not swapped out: the contents were dropped by MADV_DONTNEED. */
+    if (slot_no == BITMAP_ERROR) {
+        if (page->anon.origin != NULL)
+            return lazy_load_segment(page, page->anon.origin);
+        memset(kva, 0, PGSIZE);
+        return true;
+    }
+
     lock_acquire(&swap_table_lock);
     if (bitmap_test(swap_table, slot_no) == false) {
         lock_release(&swap_table_lock);
         return false;
     }
 
-    for (int i = 0; i < 8; ++i)
-        disk_read(swap_disk, (slot_no * 8) + i, kva + (DISK_SECTOR_SIZE * i));
+    disk_read_multiple(swap_disk, slot_no * SECTORS_PER_PAGE,
+                       SECTORS_PER_PAGE, kva);
+    anon_swap_ins++;
 
-    bitmap_set(swap_table, slot_no, false);
+    swap_slot_release(slot_no);
+    page->slot_no = BITMAP_ERROR;
+    anon_swap_readahead(page, slot_no);
     lock_release(&swap_table_lock);
 
     return true;
 }
 
-/* Swap out the page by writing contents to the swap disk. */
-static bool anon_swap_out(struct page *page) {
+/* Brings in the pages stored in the slots following SLOT_NO, as long
+ * as they belong to the same process as PAGE and a free frame is
+ * available without evicting anything.  Clustered swap-out places
+ * virtually adjacent pages in adjacent slots, so this is the cheapest
+ * point to fetch the pages a sequential access will touch next.
+ * Caller must hold swap_table_lock. */
+static void
+anon_swap_readahead(struct page *page, size_t slot_no) {
+    size_t last = slot_no + SWAP_READAHEAD_PAGES;
+
+    if (page->advice == MADV_RANDOM)
+        return;
+    if (last > bitmap_size(swap_table))
+        last = bitmap_size(swap_table);
+
+    for (size_t slot = slot_no + 1; slot < last; slot++) {
+        struct page *next = swap_slot_page[slot];
+        struct frame *frame;
+
+        if (next == NULL || next->owner != page->owner || next->frame != NULL)
+            break;
+        if (rss_over_limit(page->owner))
+            break;
+
+        frame = vm_try_get_frame();
+        if (frame == NULL)
+            break;
+
+        disk_read_multiple(swap_disk, slot * SECTORS_PER_PAGE,
+                           SECTORS_PER_PAGE, frame->kva);
+        frame->page = next;
+        vm_set_frame(next, frame);
+        if (!vm_map_page(next, frame->kva, next->writable)) {
+            vm_set_frame(next, NULL);
+            frame->page = NULL;
+            free_frame(frame);
+            break;
+        }
+        swap_slot_release(slot);
+        next->slot_no = BITMAP_ERROR;
+        unpin_frame(frame);
+        anon_swap_ins++;
+    }
+}
+
+/* Swap out up to CNT pages, which must be resident anonymous pages of
+ * one process ordered by virtual address.  The whole cluster is unmapped
+ * first, so that no store of the owner can land in a frame after it has
+ * been copied.  Each page is then offered to the compressed pool; the
+ * rest are written to contiguous swap slots.  If no run of free slots is
+ * long enough, the run is shortened until one fits and the pages past
+ * its end are mapped again.  Returns the number of pages swapped out;
+ * their frames (page->frame before the call) are detached but not freed,
+ * and page->frame is NULL afterwards. */
+size_t anon_swap_out_cluster(struct page **pages, size_t cnt) {
+    struct page *disk_pages[SWAP_CLUSTER_PAGES];
+    size_t disk_cnt = 0, done = 0, slot_no;
+    struct mmu_gather tlb;
+
+    ASSERT(cnt <= SWAP_CLUSTER_PAGES);
+
+    /* One flush for the whole cluster, completed before any copy. */
+    mmu_gather_begin(&tlb, pages[0]->owner->pml4);
+    for (size_t i = 0; i < cnt; i++)
+        vm_unmap_page(pages[i]);
+    mmu_gather_end(&tlb);
+
+    for (size_t i = 0; i < cnt; i++) {
+        struct page *page = pages[i];
+        struct zswap_entry *entry = zswap_store(page->frame->kva);
+
+        if (entry != NULL) {
+            page->anon.zswap = entry;
+            vm_set_frame(page, NULL);
+            done++;
+        } else
+            disk_pages[disk_cnt++] = page;
+    }
+    anon_swap_outs += done;
+    if (disk_cnt == 0)
+        return done;
 
     lock_acquire(&swap_table_lock);
-    size_t slot_no = bitmap_scan_and_flip(swap_table, 0, 1, false);
+    slot_no = bitmap_scan_and_flip(swap_table, 0, disk_cnt, false);
+    while (slot_no == BITMAP_ERROR && disk_cnt > 1) {
+        disk_cnt /= 2;
+        slot_no = bitmap_scan_and_flip(swap_table, 0, disk_cnt, false);
+    }
 
-    if (slot_no == BITMAP_ERROR) 
-        return false;
-    
-    for (int i = 0; i < 8; ++i) 
-        disk_write(swap_disk, (slot_no * 8) + i, page->va + (DISK_SECTOR_SIZE * i));
-    
-    pml4_clear_page(thread_current()->pml4, page->va);
+    for (size_t i = 0; slot_no != BITMAP_ERROR && i < disk_cnt; i++) {
+        struct page *page = disk_pages[i];
 
-    page->slot_no = slot_no;
+        disk_write_multiple(swap_disk, (slot_no + i) * SECTORS_PER_PAGE,
+                            SECTORS_PER_PAGE, page->frame->kva);
+        swap_slot_page[slot_no + i] = page;
+        page->slot_no = slot_no + i;
+        vm_set_frame(page, NULL);
+    }
+    lock_release(&swap_table_lock);
+
+    /* Map the pages that found no slot again. */
+    if (slot_no == BITMAP_ERROR)
+        disk_cnt = 0;
+    for (size_t i = disk_cnt; i < cnt - done; i++) {
+        struct page *page = disk_pages[i];
+
+        if (!vm_map_page(page, page->frame->kva, page->writable))
+            PANIC("anon: cannot map back a page left resident");
+    }
+    anon_swap_outs += disk_cnt;
+    return done + disk_cnt;
+}
+
+/* Writes the page at KVA to a free swap slot, for a page that no
+ * single struct page owns, and returns the slot or BITMAP_ERROR if swap
+ * is full. */
+size_t anon_swap_write(const void *kva) {
+    size_t slot_no;
+
+    lock_acquire(&swap_table_lock);
+    slot_no = bitmap_scan_and_flip(swap_table, 0, 1, false);
+    if (slot_no != BITMAP_ERROR) {
+        disk_write_multiple(swap_disk, slot_no * SECTORS_PER_PAGE,
+                            SECTORS_PER_PAGE, kva);
+        anon_swap_outs++;
+    }
+    lock_release(&swap_table_lock);
+    return slot_no;
+}
+
+/* Reads swap slot SLOT_NO, written by anon_swap_write(), into KVA and
+ * releases the slot. */
+void anon_swap_read(size_t slot_no, void *kva) {
+    lock_acquire(&swap_table_lock);
+    disk_read_multiple(swap_disk, slot_no * SECTORS_PER_PAGE,
+                       SECTORS_PER_PAGE, kva);
+    swap_slot_release(slot_no);
+    lock_release(&swap_table_lock);
+    anon_swap_ins++;
+}
+
+/* Releases swap slot SLOT_NO, written by anon_swap_write(), unread. */
+void anon_swap_free(size_t slot_no) {
+    lock_acquire(&swap_table_lock);
+    swap_slot_release(slot_no);
     lock_release(&swap_table_lock);
-    return true;
+}
+
+/* Releases the swap slots of all anonymous pages in SPT, the current
+ * process's, which is exiting, under one hold of swap_table_lock.
+ * Caller holds the spt lock. */
+void anon_swap_release(struct supplemental_page_table *spt) {
+    struct hash_iterator i;
+
+    lock_acquire(&swap_table_lock);
+    hash_first(&i, &spt->hash_spt);
+    while (hash_next(&i)) {
+        struct page *page = hash_entry(hash_cur(&i), struct page, hash_elem);
+
+        if (page->operations->type == VM_ANON && page->slot_no != BITMAP_ERROR) {
+            swap_slot_release(page->slot_no);
+            page->slot_no = BITMAP_ERROR;
+        }
+    }
+    lock_release(&swap_table_lock);
+}
+
+/* Swap out the page by writing contents to the swap disk. */
+static bool anon_swap_out(struct page *page) {
+    return anon_swap_out_cluster(&page, 1) == 1;
 }
 
 /* Destroy the anonymous page. PAGE will be freed by the caller. */
 static void anon_destroy(struct page *page) {
     struct anon_page *anon_page = &page->anon;
-    lock_acquire(&swap_table_lock);
-    bitmap_set(swap_table, page->slot_no, true);
-    lock_release(&swap_table_lock);
-    if (page->frame && page->frame->page == page) {
-        free_frame(page->frame);
+
+    huge_split(page);
+    zswap_free(anon_page->zswap);
+    anon_page->zswap = NULL;
+    if (page->slot_no != BITMAP_ERROR) {
+        lock_acquire(&swap_table_lock);
+        if (page->slot_no != BITMAP_ERROR) {
+            swap_slot_release(page->slot_no);
+            page->slot_no = BITMAP_ERROR;
+        }
+        lock_release(&swap_table_lock);
     }
-    pml4_clear_page(thread_current()->pml4, page->va);
+    vm_unmap_page(page);
+    vm_release_frame(page);
 }
@@ -0,0 +1,123 @@
+/* faultstat.c: Page fault counters and latency histograms.
+ *
+ * Every fault resolved by vm_try_handle_fault() is timed with the TSC
+ * and added, by kind, to the faulting process's counters and to the
+ * global ones.  The per-process counters are allocated on the first
+ * fault and freed at exit. */
+
+#include "vm/faultstat.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include <stdio.h>
+#include <string.h>
+
+bool faultstat_verbose;
+
+static const char *fault_kind_names[FAULT_KIND_CNT] = {
+    "stack", "exec", "file", "zero", "swap", "cow",
+};
+
+/* Counters of all processes since boot. */
+static struct fault_stats global_stats;
+static struct lock global_stats_lock;
+
+void faultstat_init(void) {
+    lock_init(&global_stats_lock);
+}
+
+/* Adds one fault of KIND that took CYCLES to STATS. */
+static void
+fault_stats_add(struct fault_stats *stats, enum fault_kind kind, uint64_t cycles) {
+    uint64_t c = cycles >> FAULT_HIST_SHIFT;
+    int bucket = 0;
+
+    while (c != 0 && bucket < FAULT_HIST_BUCKETS - 1) {
+        c >>= 1;
+        bucket++;
+    }
+    stats->count[kind]++;
+    stats->cycles[kind] += cycles;
+    stats->hist[kind][bucket]++;
+}
+
+/* Records a fault of KIND in the current process that took CYCLES. */
+void faultstat_record(enum fault_kind kind, uint64_t cycles) {
+    struct thread *t = thread_current();
+
+    if (t->fault_stats == NULL)
+        t->fault_stats = calloc(1, sizeof *t->fault_stats);
+    if (t->fault_stats != NULL)
+        fault_stats_add(t->fault_stats, kind, cycles);
+
+    lock_acquire(&global_stats_lock);
+    fault_stats_add(&global_stats, kind, cycles);
+    lock_release(&global_stats_lock);
+}
+
+/* Returns the number of faults of KIND handled since boot, or of all
+ * kinds if KIND is FAULT_KIND_CNT. */
+unsigned long long faultstat_global_count(enum fault_kind kind) {
+    unsigned long long sum = 0;
+
+    lock_acquire(&global_stats_lock);
+    if (kind != FAULT_KIND_CNT)
+        sum = global_stats.count[kind];
+    else
+        for (int k = 0; k < FAULT_KIND_CNT; k++)
+            sum += global_stats.count[k];
+    lock_release(&global_stats_lock);
+    return sum;
+}
+
+/* Copies the current process's counters, or the global ones if GLOBAL,
+ * into BUF, which may be a user address.  Returns 0 on success, -1 if
+ * out of memory. */
+int faultstat_query(struct fault_stats *buf, bool global) {
+    struct fault_stats *copy = calloc(1, sizeof *copy);
+    struct thread *t = thread_current();
+
+    if (copy == NULL)
+        return -1;
+    if (global) {
+        lock_acquire(&global_stats_lock);
+        *copy = global_stats;
+        lock_release(&global_stats_lock);
+    } else if (t->fault_stats != NULL)
+        *copy = *t->fault_stats;
+
+    /* Copy out without holding the lock; BUF may fault. */
+    memcpy(buf, copy, sizeof *copy);
+    free(copy);
+    return 0;
+}
+
+/* Prints one line per kind of fault that occurred in STATS. */
+static void
+fault_stats_print(const char *who, const struct fault_stats *stats) {
+    for (int kind = 0; kind < FAULT_KIND_CNT; kind++) {
+        if (stats->count[kind] == 0)
+            continue;
+        printf("%s: %s faults: %llu, %llu cycles avg, histogram",
+               who, fault_kind_names[kind], stats->count[kind],
+               stats->cycles[kind] / stats->count[kind]);
+        for (int i = 0; i < FAULT_HIST_BUCKETS; i++)
+            printf(" %llu", stats->hist[kind][i]);
+        printf("\n");
+    }
+}
+
+/* Prints and frees the counters of T, which is exiting. */
+void faultstat_exit(struct thread *t) {
+    if (t->fault_stats == NULL)
+        return;
+    if (faultstat_verbose)
+        fault_stats_print(t->name, t->fault_stats);
+    free(t->fault_stats);
+    t->fault_stats = NULL;
+}
+
+void faultstat_print_stats(void) {
+    if (faultstat_verbose)
+        fault_stats_print("faults", &global_stats);
+}
@@ -1,13 +1,58 @@
-/* file.c: Implementation of memory backed file object (mmaped object). */
+/* file.c: Implementation of memory backed file object (mmaped object).
+ *
+ * Dirty pages are written back in runs: the pages that follow a dirty
+ * page and continue its file range are gathered into one buffer and
+ * written with a single file write, so that msync(), munmap() and
+ * eviction cost one write per run instead of one per page.
+ *
+ * An exiting process does not write at all: it hands its runs, frames
+ * included, to writebackd and goes on.  The queued runs are written
+ * before any read(), write() or mmap() of a file, so those see the data
+ * of processes that exited before; pages of mappings that exist already
+ * may still be read from the file before the queue drains. */
 
 #include "vm/vm.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
 #include "threads/vaddr.h"
 #include "userprog/process.h"
 #include "threads/mmu.h"
+#include <mman.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Longest run of pages written back with one file write. */
+#define WRITEBACK_CLUSTER_PAGES 16
+
+/* Most pages queued for writebackd; exiting processes write the rest
+ * themselves, so that queued frames do not starve the user pool. */
+#define WRITEBACK_QUEUE_MAX 128
+
+/* A run of dirty pages of an exited process, queued for writebackd. */
+struct writeback_req {
+    struct file *file;  /* File of the mapping, which stays open. */
+    off_t offset;       /* File offset of the first page. */
+    size_t bytes;       /* Bytes to write. */
+    size_t cnt;         /* Number of FRAMES. */
+    struct frame *frames[WRITEBACK_CLUSTER_PAGES]; /* One reference each. */
+    struct list_elem elem;
+};
 
 extern struct lock file_lock;
 extern struct lock frame_table_lock;
 
+static uint8_t *writeback_buf;     /* Gathers a run; guarded by file_lock. */
+static long long writeback_pages;  /* Pages written back. */
+static long long writeback_writes; /* File writes that wrote them. */
+static long long writeback_deferred; /* Pages queued by exiting processes. */
+
+static struct list writeback_queue;    /* Pending writeback_reqs. */
+static struct lock writeback_lock;     /* Protects the queue and writeback_queued. */
+static struct condition writeback_work; /* Signalled when a run is queued. */
+static size_t writeback_queued;        /* Pages in the queue. */
+
+static void writebackd(void *aux UNUSED);
+
 static bool file_backed_swap_in(struct page *page, void *kva);
 static bool file_backed_swap_out(struct page *page);
 static void file_backed_destroy(struct page *page);
@@ -22,6 +67,11 @@ static const struct page_operations file_ops = {
 
 /* The initializer of file vm */
 void vm_file_init(void) {
+    writeback_buf = palloc_get_multiple(PAL_ASSERT, WRITEBACK_CLUSTER_PAGES);
+    list_init(&writeback_queue);
+    lock_init(&writeback_lock);
+    cond_init(&writeback_work);
+    thread_create("writebackd", PRI_DEFAULT, writebackd, NULL);
 }
 
 /* Initialize the file backed page */
@@ -30,9 +80,11 @@ bool file_backed_initializer(struct page *page, enum vm_type type, void *kva) {
     page->operations = &file_ops;
 
     struct file_page *file_page = &page->file;
+    return true;
 }
 
-/* Swap in the page by read contents from the file. */
+/* Swap in the page by read contents from the file.  The runs queued
+ * for writebackd are written first, as they may hold newer contents. */
 static bool file_backed_swap_in(struct page *page, void *kva) {
     struct file_page *file_page = &page->file;
     if (page == NULL)
@@ -43,8 +95,16 @@ static bool file_backed_swap_in(struct page *page, void *kva) {
     off_t offset = aux->offset;
     size_t page_read_bytes = aux->page_read_bytes;
     size_t page_zero_bytes = aux->page_zero_bytes;
+    bool held = lock_held_by_current_thread(&file_lock);
+    off_t bytes_read;
 
-    if (file_read_at(file, page->frame->kva, page_read_bytes, offset) != (int)page_read_bytes) {
+    if (!held)
+        lock_acquire(&file_lock);
+    file_writeback_flush();
+    bytes_read = file_read_at(file, page->frame->kva, page_read_bytes, offset);
+    if (!held)
+        lock_release(&file_lock);
+    if (bytes_read != (int)page_read_bytes) {
         return false;
     }
 
@@ -53,25 +113,164 @@ static bool file_backed_swap_in(struct page *page, void *kva) {
     return true;
 }
 
-/* Swap out the page by writeback contents to the file. */
-static bool file_backed_swap_out(struct page *page) {
-    struct file_page *file_page = &page->file;
-    struct load_aux *aux = page->uninit.aux;
+/* Returns true if file-backed page NEXT continues the file range of
+ * file-backed page PREV. */
+static bool
+file_page_follows(struct page *prev, struct page *next) {
+    struct load_aux *a = prev->uninit.aux;
+    struct load_aux *b = next->uninit.aux;
 
-    if (page == NULL)
+    return a->file == b->file && a->page_read_bytes == PGSIZE && b->offset == a->offset + PGSIZE;
+}
+
+/* Returns true, with PAGE's frame pinned and its dirty bit cleared, if
+ * PAGE is a resident file-backed page that was written to and, if PREV
+ * is nonnull, continues the file range of PREV.  A frame pinned already
+ * is being evicted, which writes it back itself. */
+static bool
+writeback_grab(struct page *page, struct page *prev) {
+    struct frame *frame;
+    uint64_t *pte;
+    bool ok;
+
+    if (page->operations->type != VM_FILE)
+        return false;
+    if (prev != NULL && !file_page_follows(prev, page))
         return false;
 
+    pte = vm_page_pte(page);
+    lock_acquire(&frame_table_lock);
+    frame = page->frame;
+    ok = frame != NULL && !frame->pinned && pte_is_dirty(pte);
+    if (ok)
+        frame->pinned = true;
+    lock_release(&frame_table_lock);
+    if (ok)
+        pte_set_dirty(page->owner->pml4, pte, page->va, false);
+    return ok;
+}
+
+/* Writes BYTES bytes of the CNT FRAMES, which hold consecutive pages of
+ * FILE from OFFSET on, to the file with one write.  Caller holds
+ * file_lock. */
+static void
+writeback_frames(struct file *file, off_t offset, size_t bytes, struct frame **frames, size_t cnt) {
+    const void *buf = frames[0]->kva;
+
+    if (cnt > 1) {
+        for (size_t i = 0; i < cnt; i++)
+            memcpy(writeback_buf + i * PGSIZE, frames[i]->kva, PGSIZE);
+        buf = writeback_buf;
+    }
+    file_write_at(file, buf, bytes, offset);
+    writeback_pages += cnt;
+    writeback_writes++;
+}
+
+/* Writes the frames of RUN, CNT pages that continue one another's file
+ * range, to the file with one write.  Caller holds file_lock. */
+static void
+writeback_write(struct page **run, size_t cnt) {
+    struct load_aux *aux = run[0]->uninit.aux;
+    struct load_aux *last = run[cnt - 1]->uninit.aux;
+    struct frame *frames[WRITEBACK_CLUSTER_PAGES];
+
+    for (size_t i = 0; i < cnt; i++)
+        frames[i] = run[i]->frame;
+    writeback_frames(aux->file, aux->offset, (cnt - 1) * PGSIZE + last->page_read_bytes, frames, cnt);
+}
+
+/* Writes back FIRST, a dirty file-backed page whose frame the caller
+ * has pinned and whose dirty bit it has cleared or whose entry it has
+ * unmapped, together with the dirty pages that follow it below END and
+ * continue its file range.  All dirty bits are read in this one sweep over the page table entries
+ * cached in the pages.  The frames of the following pages are unpinned
+ * again; FIRST's stays pinned.  Returns the address of the first page
+ * after the run.  Caller holds file_lock. */
+static uint8_t *
+writeback_run(struct page *first, uint8_t *end) {
+    struct page *run[WRITEBACK_CLUSTER_PAGES];
+    struct page *prev = first;
+    uint8_t *va = (uint8_t *)first->va + PGSIZE;
+    size_t cnt = 1;
+
+    run[0] = first;
+    for (; va < end; va += PGSIZE) {
+        struct page *page = spt_find_page(&first->owner->spt, va);
+
+        if (page == NULL || !writeback_grab(page, prev))
+            break;
+        if (cnt == WRITEBACK_CLUSTER_PAGES) {
+            writeback_write(run, cnt);
+            cnt = 0;
+        }
+        run[cnt++] = prev = page;
+    }
+    writeback_write(run, cnt);
+
+    lock_acquire(&frame_table_lock);
+    for (uint8_t *p = (uint8_t *)first->va + PGSIZE; p < va; p += PGSIZE)
+        vm_unpin_frame(spt_find_page(&first->owner->spt, p)->frame);
+    lock_release(&frame_table_lock);
+    return va;
+}
+
+/* Writes back PAGE, if it is a dirty file-backed page, with the run
+ * that it starts below END.  Returns the address of the first page
+ * after what was written.  Caller holds file_lock. */
+static uint8_t *
+writeback_from(struct page *page, uint8_t *end) {
+    uint8_t *va;
+
+    if (!writeback_grab(page, NULL))
+        return (uint8_t *)page->va + PGSIZE;
+    va = writeback_run(page, end);
+    unpin_frame(page->frame);
+    return va;
+}
+
+/* Writes back the dirty pages of the current process's file mappings
+ * that lie in [START, END).  Caller holds the spt lock. */
+static void
+writeback_range(uint8_t *start, uint8_t *end) {
+    struct supplemental_page_table *spt = &thread_current()->spt;
+    uint8_t *va = start;
+
     lock_acquire(&file_lock);
-    if (pml4_is_dirty(thread_current()->pml4, page->va)) {
-        file_write_at(aux->file, page->frame->kva, aux->page_read_bytes, aux->offset);
-        lock_release(&file_lock);
-        pml4_set_dirty(thread_current()->pml4, page->va, 0);
+    while (va < end) {
+        struct page *page = spt_find_page(spt, va);
+
+        va = page != NULL ? writeback_from(page, end) : va + PGSIZE;
     }
+    lock_release(&file_lock);
+}
+
+/* Swap out the page by writeback contents to the file.  The dirty pages
+ * that follow it in its mapping are written back with it.  Caller holds
+ * the owner's spt lock.  The owner may hold file_lock while it waits
+ * for that, so file_lock is not waited for: returns false if it is
+ * busy. */
+static bool file_backed_swap_out(struct page *page) {
+    bool held = lock_held_by_current_thread(&file_lock);
+    uint64_t *pte;
+
+    if (page == NULL)
+        return false;
+
+    if (!held && !lock_try_acquire(&file_lock))
+        return false;
+    /* Unmap first, so that no store of the owner lands in the frame
+     * after it has been written.  The cleared entry keeps its dirty
+     * bit; remapping rewrites the whole entry, dirty bit included. */
+    pte = vm_page_pte(page);
+    vm_unmap_page(page);
+    if (pte_is_dirty(pte))
+        writeback_run(page, (uint8_t *)page->va + WRITEBACK_CLUSTER_PAGES * PGSIZE);
 
-    pml4_clear_page(thread_current()->pml4, page->va);
     page->frame->page = NULL;
-    page->frame = NULL;
-    lock_release(&file_lock);
+    vm_set_frame(page, NULL);
+    if (!held)
+        lock_release(&file_lock);
 
     return true;
 }
@@ -79,28 +278,21 @@ static bool file_backed_swap_out(struct page *page) {
 /* Destory the file backed page. PAGE will be freed by the caller. */
 static void file_backed_destroy(struct page *page) {
     struct load_aux *aux = page->uninit.aux;
-    struct thread *curr = thread_current();
-    lock_acquire(&file_lock);
-    if (pml4_is_dirty(thread_current()->pml4, page->va)) {
-        if (file_write_at(aux->file, page->frame->kva, aux->page_read_bytes, aux->offset) != (int)aux->page_read_bytes) {
-            lock_release(&file_lock);
-            return false;
-        }
-        pml4_set_dirty(thread_current()->pml4, page->va, 0);
-    }
-    lock_release(&file_lock);
 
-    if (page->frame && page->frame->page == page) {
+    if (page->frame != NULL && pte_is_dirty(vm_page_pte(page))) {
         lock_acquire(&file_lock);
-        free_frame(page->frame);
+        file_write_at(aux->file, page->frame->kva, aux->page_read_bytes, aux->offset);
         lock_release(&file_lock);
     }
-    pml4_clear_page(curr->pml4, page->va);
+
+    vm_unmap_page(page);
+    vm_release_frame(page);
 }
 
 /* Do the mmap */
 void *
 do_mmap(void *addr, size_t length, int writable, struct file *file, off_t offset) {
+    struct supplemental_page_table *spt = &thread_current()->spt;
     void *upage = addr;
     struct file *file_for_map = file_reopen(file);
     size_t read_bytes = file_length(file_for_map) < length ? file_length(file_for_map) : length;
@@ -109,6 +301,10 @@ do_mmap(void *addr, size_t length, int writable, struct file *file, off_t offset
     ASSERT((read_bytes + zero_bytes) % PGSIZE == 0);
     ASSERT(pg_ofs(upage) == 0);
     ASSERT(offset % PGSIZE == 0);
+    lock_acquire(&file_lock);
+    file_writeback_flush();
+    lock_release(&file_lock);
+    lock_acquire(&spt->lock);
     while (read_bytes > 0 || zero_bytes > 0) {
         /* Do calculate how to fill this page.
          * We will read PAGE_READ_BYTES bytes from FILE
@@ -123,10 +319,13 @@ do_mmap(void *addr, size_t length, int writable, struct file *file, off_t offset
         aux->page_read_bytes = page_read_bytes;
         aux->page_zero_bytes = page_zero_bytes;
         aux->length = length;
+        aux->shared = (writable & MAP_SHARED) != 0;
 
         if (!vm_alloc_page_with_initializer(VM_FILE, upage,
-                                            writable, lazy_load_segment, aux))
+                                            writable & MAP_WRITE, lazy_load_segment, aux)) {
+            lock_release(&spt->lock);
             return false;
+        }
 
         /* Advance. */
         read_bytes -= page_read_bytes;
@@ -134,6 +333,10 @@ do_mmap(void *addr, size_t length, int writable, struct file *file, off_t offset
         upage += PGSIZE;
         offset += page_read_bytes;
     }
+    lock_release(&spt->lock);
+
+    if (writable & MAP_POPULATE)
+        vm_populate(addr, length);
     return addr;
 }
 
@@ -143,7 +346,12 @@ void do_munmap(void *addr) {
     struct page *page = spt_find_page(&curr->spt, addr);
     struct load_aux *aux = page->uninit.aux;
     int map_pg_cnt = ((aux->length) % PGSIZE == 0) ? (aux->length / PGSIZE) : (aux->length / PGSIZE + 1);
+    void *start = addr;
+    struct mmu_gather tlb;
 
+    lock_acquire(&curr->spt.lock);
+    writeback_range(start, (uint8_t *)start + map_pg_cnt * PGSIZE);
+    mmu_gather_begin(&tlb, curr->pml4);
     while (map_pg_cnt != 0) {
         if (page) {
             destroy(page);
@@ -152,4 +360,183 @@ void do_munmap(void *addr) {
         page = spt_find_page(&curr->spt, addr);
         map_pg_cnt--;
     }
+    pml4_free_tables(curr->pml4, start, addr);
+    mmu_gather_end(&tlb);
+    lock_release(&curr->spt.lock);
+}
+
+/* Writes back the dirty pages of the current process's file mappings
+ * in [ADDR, ADDR + LENGTH).  ADDR must be page-aligned; pages in the
+ * range that are not file-backed are ignored.  Returns 0 on success, -1
+ * on a bad argument. */
+int do_msync(void *addr, size_t length) {
+    struct supplemental_page_table *spt = &thread_current()->spt;
+    uint8_t *start = addr, *end;
+
+    if (start == NULL || pg_ofs(start) != 0 || length == 0)
+        return -1;
+    end = pg_round_up(start + length);
+    if (end <= start || !is_user_vaddr(end - 1))
+        return -1;
+
+    lock_acquire(&spt->lock);
+    writeback_range(start, end);
+    lock_release(&spt->lock);
+    return 0;
+}
+
+/* Writes the runs queued for writebackd, oldest first, and drops their
+ * references to the frames.  Runs leave the queue only under file_lock,
+ * so a holder of file_lock that finds the queue empty knows that every
+ * queued run is in the file.  Caller holds file_lock. */
+static void
+writeback_drain(void) {
+    for (;;) {
+        struct writeback_req *req;
+
+        lock_acquire(&writeback_lock);
+        if (list_empty(&writeback_queue)) {
+            lock_release(&writeback_lock);
+            return;
+        }
+        req = list_entry(list_pop_front(&writeback_queue), struct writeback_req, elem);
+        writeback_queued -= req->cnt;
+        lock_release(&writeback_lock);
+
+        writeback_frames(req->file, req->offset, req->bytes, req->frames, req->cnt);
+        lock_acquire(&frame_table_lock);
+        for (size_t i = 0; i < req->cnt; i++)
+            vm_put_frame(req->frames[i]);
+        lock_release(&frame_table_lock);
+        free(req);
+    }
+}
+
+static void
+writebackd(void *aux UNUSED) {
+    for (;;) {
+        lock_acquire(&writeback_lock);
+        while (list_empty(&writeback_queue))
+            cond_wait(&writeback_work, &writeback_lock);
+        lock_release(&writeback_lock);
+
+        lock_acquire(&file_lock);
+        writeback_drain();
+        lock_release(&file_lock);
+    }
+}
+
+static void
+writeback_queue_req(struct writeback_req *req) {
+    lock_acquire(&writeback_lock);
+    list_push_back(&writeback_queue, &req->elem);
+    writeback_queued += req->cnt;
+    writeback_deferred += req->cnt;
+    cond_signal(&writeback_work, &writeback_lock);
+    lock_release(&writeback_lock);
+}
+
+/* Queues the run of dirty pages that starts with PAGE for writebackd,
+ * in requests of up to WRITEBACK_CLUSTER_PAGES pages.  The frames go
+ * with the run: the pages lose them, so destroying the pages writes
+ * nothing.  A page left over for want of memory keeps its frame and its
+ * dirty bit.  Caller holds the spt lock. */
+static void
+writeback_defer(struct page *page) {
+    struct writeback_req *req = NULL;
+    struct page *prev = NULL;
+
+    while (page != NULL && writeback_grab(page, prev)) {
+        struct load_aux *aux = page->uninit.aux;
+        struct frame *frame = page->frame;
+
+        if (req != NULL && req->cnt == WRITEBACK_CLUSTER_PAGES) {
+            writeback_queue_req(req);
+            req = NULL;
+        }
+        if (req == NULL) {
+            req = malloc(sizeof *req);
+            if (req == NULL) {
+                pte_set_dirty(page->owner->pml4, vm_page_pte(page), page->va, true);
+                unpin_frame(frame);
+                return;
+            }
+            req->file = aux->file;
+            req->offset = aux->offset;
+            req->bytes = 0;
+            req->cnt = 0;
+        }
+        req->frames[req->cnt++] = frame;
+        req->bytes += aux->page_read_bytes;
+
+        /* PAGE's reference to the frame passes to REQ.  Without a page
+         * the frame is not evicted or merged meanwhile. */
+        lock_acquire(&frame_table_lock);
+        if (frame->page == page)
+            frame->page = NULL;
+        vm_set_frame(page, NULL);
+        vm_unpin_frame(frame);
+        lock_release(&frame_table_lock);
+
+        prev = page;
+        page = spt_find_page(&page->owner->spt, (uint8_t *)page->va + PGSIZE);
+    }
+    if (req != NULL)
+        writeback_queue_req(req);
+}
+
+/* Writes back the dirty pages of all file mappings in SPT, the current
+ * process's, which is exiting.  Each run is queued for writebackd from
+ * the page that starts it, or written at once while the queue is full.
+ * Caller holds the spt lock. */
+void file_writeback_exit(struct supplemental_page_table *spt) {
+    struct hash_iterator i;
+
+    hash_first(&i, &spt->hash_spt);
+    while (hash_next(&i)) {
+        struct page *page = hash_entry(hash_cur(&i), struct page, hash_elem);
+        struct page *prev;
+
+        if (page->operations->type != VM_FILE || page->frame == NULL || !pte_is_dirty(vm_page_pte(page)))
+            continue;
+        prev = spt_find_page(spt, (uint8_t *)page->va - PGSIZE);
+        if (prev != NULL && prev->operations->type == VM_FILE && prev->frame != NULL
+            && pte_is_dirty(vm_page_pte(prev)) && file_page_follows(prev, page))
+            continue;
+
+        if (writeback_queued < WRITEBACK_QUEUE_MAX)
+            writeback_defer(page);
+        else {
+            lock_acquire(&file_lock);
+            writeback_from(page, (uint8_t *)KERN_BASE);
+            lock_release(&file_lock);
+        }
+    }
+}
+
+/* Writes the runs that exited processes queued, so that the file access
+ * that follows sees them.  Caller holds file_lock. */
+void file_writeback_flush(void) {
+    if (writeback_queued != 0)
+        writeback_drain();
+}
+
+/* Writes the queued runs, so that their frames can go back to the user
+ * pool.  Returns false if nothing was queued. */
+bool file_writeback_reclaim(void) {
+    bool held = lock_held_by_current_thread(&file_lock);
+
+    if (writeback_queued == 0)
+        return false;
+    if (!held)
+        lock_acquire(&file_lock);
+    writeback_drain();
+    if (!held)
+        lock_release(&file_lock);
+    return true;
+}
+
+void file_print_stats(void) {
+    printf("writeback: %lld mapped pages in %lld file writes, %lld deferred at exit\n",
+           writeback_pages, writeback_writes, writeback_deferred);
 }
@@ -0,0 +1,249 @@
+/* heap.c: The program break and anonymous mappings.
+ *
+ * Both are ranges of lazily allocated VM_ANON pages that start out
+ * zeroed.  The heap starts right after the highest segment of the
+ * executable and moves with sbrk().  Anonymous mappings come from
+ * mmap() with MAP_ANON; without an address, the kernel places them
+ * below ANON_MAP_TOP in the highest gap between the mappings already
+ * there.  Shared memory segments are attached the same way, as
+ * mappings whose pages show the segment's (see vm/shm.c).  The ranges
+ * are part of the address space, so they live in the supplemental page
+ * table and are guarded by its lock. */
+
+#include "vm/heap.h"
+#include "vm/shm.h"
+#include "vm/vm.h"
+#include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/thread.h"
+#include <mman.h>
+#include <round.h>
+
+/* An anonymous mapping. */
+struct anon_map {
+    uint8_t *start;       /* First page. */
+    size_t size;          /* Length in bytes, a multiple of PGSIZE. */
+    struct shm_segment *shm; /* Segment attached here, or NULL. */
+    struct list_elem elem;
+};
+
+void heap_init(struct supplemental_page_table *spt) {
+    spt->heap_start = spt->heap_brk = NULL;
+    list_init(&spt->anon_maps);
+}
+
+/* Copies the heap and mapping layout of SRC into DST, whose pages are
+ * copied separately.  Returns false if out of memory. */
+bool heap_copy(struct supplemental_page_table *dst, struct supplemental_page_table *src) {
+    struct list_elem *e;
+
+    dst->heap_start = src->heap_start;
+    dst->heap_brk = src->heap_brk;
+    for (e = list_begin(&src->anon_maps); e != list_end(&src->anon_maps); e = list_next(e)) {
+        struct anon_map *map = list_entry(e, struct anon_map, elem);
+        struct anon_map *copy = malloc(sizeof *copy);
+
+        if (copy == NULL)
+            return false;
+        copy->start = map->start;
+        copy->size = map->size;
+        copy->shm = map->shm;
+        if (copy->shm != NULL)
+            shm_get(copy->shm);
+        list_push_back(&dst->anon_maps, &copy->elem);
+    }
+    return true;
+}
+
+/* Forgets the layout of SPT, whose pages are already gone. */
+void heap_kill(struct supplemental_page_table *spt) {
+    while (!list_empty(&spt->anon_maps)) {
+        struct anon_map *map = list_entry(list_pop_front(&spt->anon_maps), struct anon_map, elem);
+
+        if (map->shm != NULL)
+            shm_put(map->shm);
+        free(map);
+    }
+    spt->heap_start = spt->heap_brk = NULL;
+}
+
+/* Places the heap of the current process right after END, the end of
+ * its executable's highest segment. */
+void heap_set_start(void *end) {
+    struct supplemental_page_table *spt = &thread_current()->spt;
+
+    spt->heap_start = spt->heap_brk = pg_round_up(end);
+}
+
+/* Removes the pages in [START, END) of the current process.  Caller
+ * holds the spt lock. */
+static void
+remove_range(uint8_t *start, uint8_t *end) {
+    struct thread *curr = thread_current();
+    struct mmu_gather tlb;
+
+    mmu_gather_begin(&tlb, curr->pml4);
+    for (uint8_t *va = start; va < end; va += PGSIZE) {
+        struct page *page = spt_find_page(&curr->spt, va);
+
+        if (page == NULL)
+            continue;
+        hash_delete(&curr->spt.hash_spt, &page->hash_elem);
+        vm_dealloc_page(page);
+    }
+    pml4_free_tables(curr->pml4, start, end);
+    mmu_gather_end(&tlb);
+}
+
+/* Adds zero-filled pages for [START, END) to the current process, or
+ * pages that show segment SHM if it is nonnull.  Fails, adding nothing,
+ * if a page in the range is in use.  Caller holds the spt lock. */
+static bool
+add_range(uint8_t *start, uint8_t *end, bool writable, struct shm_segment *shm) {
+    struct supplemental_page_table *spt = &thread_current()->spt;
+
+    if (start >= end || !is_user_vaddr(end - 1))
+        return start == end;
+    for (uint8_t *va = start; va < end; va += PGSIZE)
+        if (spt_find_page(spt, va) != NULL)
+            return false;
+
+    for (uint8_t *va = start; va < end; va += PGSIZE) {
+        bool ok = shm != NULL ? shm_add_page(shm, (va - start) / PGSIZE, va, writable)
+                              : vm_alloc_page(VM_ANON, va, writable);
+
+        if (!ok) {
+            remove_range(start, va);
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Moves the break of the current process by INCREMENT bytes.  Returns
+ * the previous break, or (void *) -1 if the heap cannot grow that far
+ * or would shrink below its start. */
+void *do_sbrk(intptr_t increment) {
+    struct supplemental_page_table *spt = &thread_current()->spt;
+    uint8_t *old_brk, *new_brk;
+    void *result = (void *)-1;
+
+    lock_acquire(&spt->lock);
+    old_brk = spt->heap_brk;
+    new_brk = old_brk + increment;
+    if (old_brk == NULL || (increment < 0 ? new_brk < spt->heap_start : new_brk < old_brk))
+        goto done;
+
+    if (increment > 0) {
+        if (new_brk > ANON_MAP_TOP || !add_range(pg_round_up(old_brk), pg_round_up(new_brk), true, NULL))
+            goto done;
+    } else
+        remove_range(pg_round_up(new_brk), pg_round_up(old_brk));
+    spt->heap_brk = new_brk;
+    result = old_brk;
+done:
+    lock_release(&spt->lock);
+    return result;
+}
+
+/* Returns the highest address below ANON_MAP_TOP and above the heap at
+ * which SIZE bytes are free of anonymous mappings, or NULL. */
+static uint8_t *
+find_gap(struct supplemental_page_table *spt, size_t size) {
+    uint8_t *bottom = pg_round_up(spt->heap_brk);
+    uint8_t *end = ANON_MAP_TOP;
+    struct list_elem *e;
+
+    if (end < bottom || size > (size_t)(end - bottom))
+        return NULL;
+
+    /* anon_maps is sorted by descending start. */
+    for (e = list_begin(&spt->anon_maps); e != list_end(&spt->anon_maps); e = list_next(e)) {
+        struct anon_map *map = list_entry(e, struct anon_map, elem);
+
+        if (map->start >= end)
+            continue;
+        if (map->start + map->size <= end - size)
+            break;
+        end = map->start;
+        if (end < bottom || size > (size_t)(end - bottom))
+            return NULL;
+    }
+    return end - size;
+}
+
+static bool
+map_higher(const struct list_elem *a, const struct list_elem *b, void *aux UNUSED) {
+    return list_entry(a, struct anon_map, elem)->start > list_entry(b, struct anon_map, elem)->start;
+}
+
+/* Maps LENGTH bytes of zero-filled memory at ADDR, or where the kernel
+ * chooses if ADDR is NULL, in the current process.  FLAGS are the MAP_*
+ * bits of mmap().  Returns the address of the mapping, or NULL. */
+void *do_mmap_anon(void *addr, size_t length, int flags) {
+    return heap_map(addr, length, flags, NULL);
+}
+
+/* Like do_mmap_anon(), but maps segment SHM instead of zero-filled
+ * memory if it is nonnull.  On success, the mapping takes over the
+ * caller's reference to SHM. */
+void *heap_map(void *addr, size_t length, int flags, struct shm_segment *shm) {
+    struct supplemental_page_table *spt = &thread_current()->spt;
+    size_t size = ROUND_UP(length, PGSIZE);
+    struct anon_map *map;
+    uint8_t *start = addr;
+
+    if (length == 0 || size < length || pg_ofs(addr) != 0)
+        return NULL;
+    map = malloc(sizeof *map);
+    if (map == NULL)
+        return NULL;
+
+    lock_acquire(&spt->lock);
+    if (start == NULL)
+        start = find_gap(spt, size);
+    if (start == NULL || start + size < start || !add_range(start, start + size, flags & MAP_WRITE, shm)) {
+        lock_release(&spt->lock);
+        free(map);
+        return NULL;
+    }
+    map->start = start;
+    map->size = size;
+    map->shm = shm;
+    list_insert_ordered(&spt->anon_maps, &map->elem, map_higher, NULL);
+    lock_release(&spt->lock);
+
+    if (flags & MAP_POPULATE)
+        vm_populate(start, size);
+    return start;
+}
+
+/* Unmaps the anonymous mapping that starts at ADDR.  Returns false if
+ * there is none. */
+bool do_munmap_anon(void *addr) {
+    return heap_unmap(addr, false);
+}
+
+/* Unmaps the anonymous mapping that starts at ADDR, if SHM_ONLY is false
+ * or it is a segment attachment.  Returns false if there is none. */
+bool heap_unmap(void *addr, bool shm_only) {
+    struct supplemental_page_table *spt = &thread_current()->spt;
+    struct list_elem *e;
+
+    lock_acquire(&spt->lock);
+    for (e = list_begin(&spt->anon_maps); e != list_end(&spt->anon_maps); e = list_next(e)) {
+        struct anon_map *map = list_entry(e, struct anon_map, elem);
+
+        if (map->start == addr && (!shm_only || map->shm != NULL)) {
+            remove_range(map->start, map->start + map->size);
+            list_remove(&map->elem);
+            lock_release(&spt->lock);
+            if (map->shm != NULL)
+                shm_put(map->shm);
+            free(map);
+            return true;
+        }
+    }
+    lock_release(&spt->lock);
+    return false;
+}
@@ -0,0 +1,142 @@
+/* hugepage.c: Transparent 2 MB pages for anonymous memory.
+ *
+ * When a fault hits a writable anonymous page that was never brought
+ * in, and so is every other page of the 2 MB-aligned block around it,
+ * the whole block is read in at once into a physically contiguous,
+ * 2 MB-aligned run of the user pool and mapped by a single page
+ * directory entry.  Each page keeps its struct page and its frame
+ * descriptor, so the rest of the VM sees 512 ordinary resident pages.
+ * Anything that changes the mapping of one of them (eviction,
+ * MADV_DONTNEED, munmap, a write-protect fault) first splits the block
+ * back into 4 kB entries with huge_split(). */
+
+#include "vm/hugepage.h"
+#include "vm/kswapd.h"
+#include "vm/vm.h"
+#include "threads/mmu.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include <stdio.h>
+
+bool huge_enabled = true;
+
+extern struct lock frame_table_lock;
+
+/* Statistics. */
+static long long huge_faults;    /* Blocks mapped by one 2 MB page. */
+static long long huge_splits;    /* 2 MB pages split into 4 kB pages. */
+static long long huge_fallbacks; /* Eligible blocks mapped 4 kB at a time. */
+
+/* Returns true if PAGE is a writable anonymous page that has never
+ * been brought in. */
+static bool
+huge_eligible(struct page *page) {
+    return page != NULL && page->operations->type == VM_UNINIT && VM_TYPE(page->uninit.type) == VM_ANON && page->writable;
+}
+
+/* Gives the frames of the run at KVA back to the user pool.  The pages
+ * of BASE that were read in already turn into anonymous pages without
+ * contents, which their next fault reads in again. */
+static void
+huge_undo(struct thread *owner, uint8_t *base, uint8_t *kva) {
+    for (size_t i = 0; i < HPAGE_PAGES; i++) {
+        struct page *page = spt_find_page(&owner->spt, base + i * PGSIZE);
+        struct frame *frame = vm_kva_to_frame(kva + i * PGSIZE);
+
+        lock_acquire(&frame_table_lock);
+        if (page->frame == frame)
+            vm_set_frame(page, NULL);
+        frame->page = NULL;
+        frame->huge = false;
+        vm_put_frame(frame);
+        lock_release(&frame_table_lock);
+    }
+}
+
+/* Tries to bring in the 2 MB block around PAGE as one 2 MB page, if
+ * every page of the block is eligible and a contiguous run of frames
+ * is free.  Nothing is evicted to make room.  Returns true if PAGE is
+ * resident afterwards.  Caller holds the spt lock. */
+bool huge_fault(struct page *page) {
+    struct thread *owner = page->owner;
+    uint8_t *base = (uint8_t *)((uint64_t)page->va & ~(HPGSIZE - 1));
+    uint8_t *kva;
+    size_t i;
+
+    if (!huge_enabled || !huge_eligible(page))
+        return false;
+    if (owner->rss_limit != 0 && owner->rss + HPAGE_PAGES > owner->rss_limit)
+        return false;
+    for (i = 0; i < HPAGE_PAGES; i++)
+        if (!huge_eligible(spt_find_page(&owner->spt, base + i * PGSIZE)))
+            return false;
+
+    kva = palloc_get_aligned(PAL_USER | PAL_ZERO, HPAGE_PAGES, HPAGE_PAGES);
+    kswapd_poke();
+    if (kva == NULL) {
+        huge_fallbacks++;
+        return false;
+    }
+
+    lock_acquire(&frame_table_lock);
+    for (i = 0; i < HPAGE_PAGES; i++) {
+        struct frame *frame = vm_kva_to_frame(kva + i * PGSIZE);
+
+        frame->page = NULL;
+        frame->ref_cnt = 1;
+        frame->pinned = true;
+        frame->huge = true;
+    }
+    lock_release(&frame_table_lock);
+
+    for (i = 0; i < HPAGE_PAGES; i++) {
+        struct page *p = spt_find_page(&owner->spt, base + i * PGSIZE);
+        struct frame *frame = vm_kva_to_frame(kva + i * PGSIZE);
+
+        frame->page = p;
+        vm_set_frame(p, frame);
+        if (!swap_in(p, frame->kva))
+            break;
+    }
+    if (i < HPAGE_PAGES || !pml4_set_huge_page(owner->pml4, base, kva, true)) {
+        huge_undo(owner, base, kva);
+        huge_fallbacks++;
+        return false;
+    }
+
+    lock_acquire(&frame_table_lock);
+    for (i = 0; i < HPAGE_PAGES; i++)
+        vm_unpin_frame(vm_kva_to_frame(kva + i * PGSIZE));
+    lock_release(&frame_table_lock);
+    huge_faults++;
+    owner->huge_faults++;
+    return true;
+}
+
+/* Splits the 2 MB page that maps PAGE, if any, back into 4 kB pages.
+ * Returns false if no page table could be allocated. */
+bool huge_split(struct page *page) {
+    struct frame *frame = page->frame, *first;
+
+    /* Frames of a 2 MB page are shared only with a forked child, which
+     * maps them with 4 kB pages of its own. */
+    if (frame == NULL || !frame->huge || frame->page != page)
+        return true;
+    if (!pml4_split_huge(page->owner->pml4, page->va))
+        return false;
+
+    first = frame - ((uint64_t)page->va & (HPGSIZE - 1)) / PGSIZE;
+    lock_acquire(&frame_table_lock);
+    for (size_t i = 0; i < HPAGE_PAGES; i++)
+        first[i].huge = false;
+    lock_release(&frame_table_lock);
+    huge_splits++;
+    return true;
+}
+
+void huge_print_stats(void) {
+    printf("huge: %lld 2 MB faults, %lld splits, %lld fallbacks\n",
+           huge_faults, huge_splits, huge_fallbacks);
+}
@@ -0,0 +1,214 @@
+/* ksm.c: Kernel same-page merging for anonymous pages.
+ *
+ * ksmd is a low-priority kernel thread that periodically walks the frame
+ * table, checksums the contents of anonymous frames, and merges frames
+ * with identical contents into one read-only frame.  The merged pages are
+ * ordinary copy-on-write pages afterwards: the first write goes through
+ * vm_handle_wp(), which copies the frame and drops the reference. */
+
+#include "vm/ksm.h"
+#include "vm/vm.h"
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/palloc.h"
+#include "threads/thread.h"
+#include <hash.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Timer ticks between two scan batches. */
+#define KSM_SLEEP_TICKS 10
+#define KSM_DEFAULT_PAGES 32
+
+extern struct frame *frame_table;
+extern size_t frame_table_size;
+extern struct lock frame_table_lock;
+
+size_t ksm_pages_to_scan = KSM_DEFAULT_PAGES;
+
+/* Frames scanned during the current pass, keyed by content checksum.
+ * Protected by frame_table_lock. */
+static struct hash ksm_table;
+static size_t ksm_cursor; /* Index in frame_table of the next frame. */
+
+/* Statistics. */
+static long long ksm_scanned; /* Frames checksummed. */
+static long long ksm_merged;  /* Pages merged into another frame. */
+static long long ksm_passes;  /* Full passes over the frame table. */
+
+static void ksmd(void *aux UNUSED);
+
+static uint64_t
+ksm_hash_func(const struct hash_elem *e, void *aux UNUSED) {
+    return hash_entry(e, struct frame, ksm_elem)->ksm_hash;
+}
+
+static bool
+ksm_less(const struct hash_elem *a, const struct hash_elem *b, void *aux UNUSED) {
+    return hash_entry(a, struct frame, ksm_elem)->ksm_hash < hash_entry(b, struct frame, ksm_elem)->ksm_hash;
+}
+
+static void
+ksm_unlist(struct hash_elem *e, void *aux UNUSED) {
+    hash_entry(e, struct frame, ksm_elem)->ksm_listed = false;
+}
+
+void ksm_init(void) {
+    hash_init(&ksm_table, ksm_hash_func, ksm_less, NULL);
+    if (ksm_pages_to_scan > 0)
+        thread_create("ksmd", PRI_MIN, ksmd, NULL);
+}
+
+/* Removes FRAME from the ksm table before it is freed.
+ * Caller must hold frame_table_lock. */
+void ksm_forget(struct frame *frame) {
+    if (frame->ksm_listed) {
+        hash_delete(&ksm_table, &frame->ksm_elem);
+        frame->ksm_listed = false;
+    }
+}
+
+/* Returns true if FRAME holds one resident anonymous page that may be
+ * merged into another frame. */
+static bool
+ksm_mergeable(struct frame *frame) {
+    struct page *page = frame->page;
+
+    return page != NULL && !frame->pinned && !frame->huge && frame->ref_cnt == 1 && page->frame == frame && page->operations->type == VM_ANON && page->owner->pml4 != NULL;
+}
+
+/* Maps PAGE read-only onto FRAME, remembering whether it was writable. */
+static void
+ksm_write_protect(struct page *page, struct frame *frame) {
+    page->parent_writable = page->writable || page->parent_writable;
+    page->writable = false;
+    vm_map_page(page, frame->kva, false);
+}
+
+/* Takes the spt lock of the owner of PAGE, unless it is busy, in which
+ * case the owner may be changing the page and NULL is returned.  ksmd
+ * holds no spt lock and the owner may be waiting for a frame, so the
+ * lock is not waited for. */
+static struct lock *
+ksm_lock_owner(struct page *page) {
+    struct lock *lock = &page->owner->spt.lock;
+
+    return lock_try_acquire(lock) ? lock : NULL;
+}
+
+/* Merges the page of frame DUP into STABLE if their contents are equal.
+ * Frees DUP on success.  The pages are rewritten under their owners'
+ * spt locks; if one is busy, nothing is merged.  Caller must hold
+ * frame_table_lock. */
+static bool
+ksm_merge(struct frame *stable, struct frame *dup) {
+    struct page *page = dup->page;
+    struct lock *dup_lock, *stable_lock = NULL;
+    enum intr_level old_level;
+    bool equal;
+
+    if (stable->pinned || (!stable->ksm && !ksm_mergeable(stable)))
+        return false;
+    dup_lock = ksm_lock_owner(page);
+    if (dup_lock == NULL)
+        return false;
+    if (!stable->ksm && stable->page->owner != page->owner) {
+        stable_lock = ksm_lock_owner(stable->page);
+        if (stable_lock == NULL) {
+            lock_release(dup_lock);
+            return false;
+        }
+    }
+
+    /* No user code may run between the comparison and the remapping,
+     * or a write could slip in after we decided the pages are equal. */
+    old_level = intr_disable();
+    equal = !memcmp(stable->kva, dup->kva, PGSIZE);
+    if (equal) {
+        if (!stable->ksm) {
+            ksm_write_protect(stable->page, stable);
+            stable->ksm = true;
+        }
+        ksm_write_protect(page, stable);
+        page->frame = stable;
+        stable->ref_cnt++;
+    }
+    intr_set_level(old_level);
+
+    if (stable_lock != NULL)
+        lock_release(stable_lock);
+    lock_release(dup_lock);
+    if (!equal)
+        return false;
+
+    vm_put_frame(dup);
+    ksm_merged++;
+    return true;
+}
+
+/* Checksums FRAME and merges it with an identical frame seen earlier in
+ * this pass, or records it for later frames to merge into.
+ * Caller must hold frame_table_lock. */
+static void
+ksm_scan_frame(struct frame *frame) {
+    struct hash_elem *e;
+
+    if (frame->ksm) {
+        /* Merged frames are read-only, so their checksum is stable. */
+        if (!frame->ksm_listed && hash_find(&ksm_table, &frame->ksm_elem) == NULL) {
+            hash_insert(&ksm_table, &frame->ksm_elem);
+            frame->ksm_listed = true;
+        }
+        return;
+    }
+    if (!ksm_mergeable(frame))
+        return;
+
+    ksm_forget(frame);
+    frame->ksm_hash = hash_bytes(frame->kva, PGSIZE);
+    ksm_scanned++;
+
+    e = hash_find(&ksm_table, &frame->ksm_elem);
+    if (e != NULL) {
+        struct frame *stable = hash_entry(e, struct frame, ksm_elem);
+        if (ksm_merge(stable, frame))
+            return;
+        /* Stale entry: its contents changed since it was scanned. */
+        ksm_forget(stable);
+    }
+    hash_insert(&ksm_table, &frame->ksm_elem);
+    frame->ksm_listed = true;
+}
+
+/* Scans the next CNT frames of the frame table. */
+static void
+ksm_scan(size_t cnt) {
+    lock_acquire(&frame_table_lock);
+    for (size_t i = 0; i < cnt; i++) {
+        if (ksm_cursor >= frame_table_size) {
+            /* Start a new pass with an empty table. */
+            hash_clear(&ksm_table, ksm_unlist);
+            ksm_cursor = 0;
+            ksm_passes++;
+        }
+        ksm_scan_frame(&frame_table[ksm_cursor++]);
+    }
+    lock_release(&frame_table_lock);
+}
+
+/* The ksmd thread. */
+static void
+ksmd(void *aux UNUSED) {
+    for (;;) {
+        timer_sleep(KSM_SLEEP_TICKS);
+        ksm_scan(ksm_pages_to_scan);
+    }
+}
+
+/* Prints same-page merging statistics. */
+void ksm_print_stats(void) {
+    printf("ksm: %lld pages scanned, %lld pages merged in %lld passes\n",
+           ksm_scanned, ksm_merged, ksm_passes);
+}
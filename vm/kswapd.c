@@ -0,0 +1,83 @@
+/* kswapd.c: Background page reclaim.
+ *
+ * Without it, a fault that finds the user pool empty evicts a page
+ * itself and waits for the swap write.  kswapd is a kernel thread that
+ * is poked whenever a frame is allocated below the low watermark and
+ * then evicts in batches until the high watermark is free again, so
+ * that faults usually find a free frame. */
+
+#include "vm/kswapd.h"
+#include "vm/vm.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include <stdio.h>
+
+/* Frames evicted between two checks of the watermark. */
+#define KSWAPD_BATCH 16
+
+/* Watermarks; SIZE_MAX means "derive from the user pool size". */
+size_t kswapd_low_wmark = SIZE_MAX;
+size_t kswapd_high_wmark = SIZE_MAX;
+
+static struct semaphore kswapd_wake;
+static bool kswapd_running; /* Woken and not yet done reclaiming. */
+
+/* Statistics. */
+static long long kswapd_wakeups;   /* Times kswapd was woken. */
+static long long kswapd_reclaimed; /* Frames returned to the pool. */
+static long long kswapd_stalls;    /* Runs that found nothing to evict. */
+
+static void kswapd(void *aux UNUSED);
+
+void kswapd_init(void) {
+    void *base;
+    size_t pages;
+
+    palloc_user_range(&base, &pages);
+    if (kswapd_low_wmark == SIZE_MAX)
+        kswapd_low_wmark = pages / 64 > 8 ? pages / 64 : 8;
+    if (kswapd_high_wmark == SIZE_MAX || kswapd_high_wmark < kswapd_low_wmark)
+        kswapd_high_wmark = 2 * kswapd_low_wmark;
+
+    sema_init(&kswapd_wake, 0);
+    if (kswapd_low_wmark > 0)
+        thread_create("kswapd", PRI_DEFAULT, kswapd, NULL);
+}
+
+/* Wakes kswapd if free frames are below the low watermark. */
+void kswapd_poke(void) {
+    if (kswapd_running || palloc_user_free_cnt() >= kswapd_low_wmark)
+        return;
+    kswapd_running = true;
+    sema_up(&kswapd_wake);
+}
+
+static void
+kswapd(void *aux UNUSED) {
+    for (;;) {
+        sema_down(&kswapd_wake);
+        kswapd_wakeups++;
+
+        while (palloc_user_free_cnt() < kswapd_high_wmark) {
+            int i;
+
+            for (i = 0; i < KSWAPD_BATCH; i++)
+                if (!vm_reclaim_frame())
+                    break;
+            kswapd_reclaimed += i;
+            if (i < KSWAPD_BATCH) {
+                /* Everything left is pinned or shared. */
+                kswapd_stalls++;
+                break;
+            }
+        }
+        kswapd_running = false;
+    }
+}
+
+void kswapd_print_stats(void) {
+    printf("kswapd: watermarks %zu/%zu, %lld wakeups, %lld frames reclaimed, %lld stalls\n",
+           kswapd_low_wmark, kswapd_high_wmark, kswapd_wakeups,
+           kswapd_reclaimed, kswapd_stalls);
+}
@@ -0,0 +1,226 @@
+/* loadctl.c: Thrashing detection and load control.
+ *
+ * Once a second the load controller looks at how many pages went to
+ * and came back from swap, and at which share of the page faults were
+ * swap-ins.  When both directions run above the threshold for two
+ * checks in a row, the combined working sets no longer fit in memory:
+ * the process with the largest working set is suspended at its next
+ * fault, its pages age out, and the others get to run in the freed
+ * frames.  Suspended processes are resumed one at a time, most recent
+ * first, once the swap-in rate has dropped below half the threshold.
+ * The last process with resident pages is never suspended. */
+
+#include "vm/loadctl.h"
+#include "vm/faultstat.h"
+#include "vm/vm.h"
+#include "devices/timer.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include <list.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/* Ticks between two checks. */
+#define LOADCTL_INTERVAL TIMER_FREQ
+
+/* Checks a process stays suspended at least. */
+#define LOADCTL_MIN_HOLD 2
+
+size_t loadctl_threshold = SIZE_MAX;
+bool loadctl_verbose;
+
+extern struct frame *frame_table;
+extern size_t frame_table_size;
+extern struct lock frame_table_lock;
+
+/* A suspended process. */
+struct thrash_hold {
+    struct thread *t;       /* Suspended process. */
+    struct semaphore sema;  /* Upped to resume it. */
+    bool blocked;           /* T is waiting on SEMA. */
+    int64_t since;          /* Tick of the suspension. */
+    struct list_elem elem;  /* In held_list. */
+};
+
+static struct list held_list;    /* Suspended processes, most recent first. */
+static struct lock loadctl_lock; /* Protects held_list and thrash_hold links. */
+
+/* Statistics. */
+static long long thrash_checks;      /* Checks that found thrashing. */
+static long long thrash_suspensions; /* Processes suspended. */
+static int64_t thrash_longest_hold;  /* Longest suspension, in ticks. */
+
+static void loadctl(void *aux UNUSED);
+
+void loadctl_init(void) {
+    void *base;
+    size_t pages;
+
+    list_init(&held_list);
+    lock_init(&loadctl_lock);
+
+    palloc_user_range(&base, &pages);
+    if (loadctl_threshold == SIZE_MAX)
+        loadctl_threshold = pages / 4 > 32 ? pages / 4 : 32;
+    if (loadctl_threshold > 0)
+        thread_create("loadctl", PRI_DEFAULT, loadctl, NULL);
+}
+
+/* Suspends the process with the largest working set, unless it is the
+ * only running one with resident pages.  Returns true if one was. */
+static bool
+loadctl_suspend(void) {
+    struct thrash_hold *hold = malloc(sizeof *hold);
+    struct thread *best = NULL, *other = NULL;
+
+    if (hold == NULL)
+        return false;
+
+    /* Owners of resident pages stay alive while frame_table_lock is
+     * held, so the hold is attached before it is released. */
+    lock_acquire(&frame_table_lock);
+    for (size_t i = 0; i < frame_table_size; i++) {
+        struct page *page = frame_table[i].page;
+        struct thread *t;
+
+        if (frame_table[i].ref_cnt == 0 || page == NULL)
+            continue;
+        t = page->owner;
+        if (t == best || t->thrash_hold != NULL)
+            continue;
+        if (best == NULL || t->wss > best->wss || (t->wss == best->wss && t->rss > best->rss)) {
+            other = best;
+            best = t;
+        } else
+            other = t;
+    }
+    if (other != NULL) {
+        hold->t = best;
+        sema_init(&hold->sema, 0);
+        hold->blocked = false;
+        hold->since = timer_ticks();
+        lock_acquire(&loadctl_lock);
+        list_push_front(&held_list, &hold->elem);
+        best->thrash_hold = hold;
+        lock_release(&loadctl_lock);
+    }
+    lock_release(&frame_table_lock);
+
+    if (other == NULL) {
+        free(hold);
+        return false;
+    }
+    thrash_suspensions++;
+    if (loadctl_verbose)
+        printf("loadctl: thrashing, suspending %s (%zu pages in working set)\n",
+               best->name, best->wss);
+    return true;
+}
+
+/* Resumes the most recently suspended process if it has been held for
+ * long enough. */
+static void
+loadctl_resume(void) {
+    struct thrash_hold *hold;
+    int64_t held;
+
+    lock_acquire(&loadctl_lock);
+    if (list_empty(&held_list)) {
+        lock_release(&loadctl_lock);
+        return;
+    }
+    hold = list_entry(list_front(&held_list), struct thrash_hold, elem);
+    held = timer_elapsed(hold->since);
+    if (held < LOADCTL_MIN_HOLD * LOADCTL_INTERVAL) {
+        lock_release(&loadctl_lock);
+        return;
+    }
+    list_remove(&hold->elem);
+    hold->t->thrash_hold = NULL;
+    if (thrash_longest_hold < held)
+        thrash_longest_hold = held;
+    if (loadctl_verbose)
+        printf("loadctl: resuming %s after %lld ticks\n", hold->t->name, held);
+
+    /* A blocked process frees the hold once it wakes up. */
+    if (hold->blocked)
+        sema_up(&hold->sema);
+    else
+        free(hold);
+    lock_release(&loadctl_lock);
+}
+
+static void
+loadctl(void *aux UNUSED) {
+    long long last_in = anon_swap_ins, last_out = anon_swap_outs;
+    unsigned long long last_faults = faultstat_global_count(FAULT_KIND_CNT);
+    unsigned long long last_major = faultstat_global_count(FAULT_SWAP);
+    int streak = 0;
+
+    for (;;) {
+        long long in, out;
+        unsigned long long faults, major;
+
+        timer_sleep(LOADCTL_INTERVAL);
+        in = anon_swap_ins - last_in;
+        out = anon_swap_outs - last_out;
+        faults = faultstat_global_count(FAULT_KIND_CNT) - last_faults;
+        major = faultstat_global_count(FAULT_SWAP) - last_major;
+        last_in += in;
+        last_out += out;
+        last_faults += faults;
+        last_major += major;
+
+        if ((size_t)in >= loadctl_threshold && (size_t)out >= loadctl_threshold && 2 * major >= faults) {
+            thrash_checks++;
+            if (++streak >= 2 && loadctl_suspend())
+                streak = 0;
+        } else {
+            streak = 0;
+            if ((size_t)in < loadctl_threshold / 2)
+                loadctl_resume();
+        }
+    }
+}
+
+/* Blocks the current process while the load controller holds it.
+ * Called on user page faults, where no kernel locks are held. */
+void loadctl_checkpoint(void) {
+    struct thread *t = thread_current();
+    struct thrash_hold *hold;
+
+    if (t->thrash_hold == NULL)
+        return;
+
+    lock_acquire(&loadctl_lock);
+    hold = t->thrash_hold;
+    if (hold != NULL)
+        hold->blocked = true;
+    lock_release(&loadctl_lock);
+
+    if (hold != NULL) {
+        sema_down(&hold->sema);
+        free(hold);
+    }
+}
+
+/* Releases the hold on T, which is exiting without having blocked.
+ * Called once T's pages are gone. */
+void loadctl_exit(struct thread *t) {
+    struct thrash_hold *hold;
+
+    lock_acquire(&loadctl_lock);
+    hold = t->thrash_hold;
+    if (hold != NULL) {
+        list_remove(&hold->elem);
+        t->thrash_hold = NULL;
+        free(hold);
+    }
+    lock_release(&loadctl_lock);
+}
+
+void loadctl_print_stats(void) {
+    printf("loadctl: threshold %zu pages/s, %lld thrashing checks, %lld suspensions, longest %lld ticks\n",
+           loadctl_threshold, thrash_checks, thrash_suspensions, thrash_longest_hold);
+}
@@ -0,0 +1,155 @@
+/* madvise.c: Access-pattern advice for ranges of user memory.
+ *
+ * MADV_RANDOM and MADV_SEQUENTIAL are recorded in each page and consulted
+ * by fault-around, swap readahead and victim selection.  MADV_DONTNEED
+ * drops the pages at once.  MADV_WILLNEED is queued for prefetchd, a
+ * kernel thread that brings the pages in while the process keeps
+ * running; it holds the owner's spt lock for one page at a time, so the
+ * owner's own faults are not held up for the whole range. */
+
+#include "vm/madvise.h"
+#include "vm/vm.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include <list.h>
+#include <mman.h>
+
+/* A range queued by MADV_WILLNEED. */
+struct prefetch_req {
+    struct thread *owner; /* Process whose pages to bring in. */
+    uint8_t *start, *end; /* Page-aligned range. */
+    struct list_elem elem;
+};
+
+static struct list prefetch_queue;       /* Pending prefetch_reqs. */
+static struct lock prefetch_lock;        /* Protects the queue and prefetch_busy. */
+static struct condition prefetch_work;   /* Signalled when a request is queued. */
+static struct condition prefetch_done;   /* Signalled when a request completes. */
+static struct thread *prefetch_busy;     /* Owner of the request in progress. */
+
+static void prefetchd(void *aux UNUSED);
+
+void madvise_init(void) {
+    list_init(&prefetch_queue);
+    lock_init(&prefetch_lock);
+    cond_init(&prefetch_work);
+    cond_init(&prefetch_done);
+    thread_create("prefetchd", PRI_DEFAULT, prefetchd, NULL);
+}
+
+/* Brings in the pages of REQ that are not resident, stopping early when
+ * no free frame is left. */
+static void
+prefetch_range(struct prefetch_req *req) {
+    struct supplemental_page_table *spt = &req->owner->spt;
+
+    for (uint8_t *va = req->start; va < req->end; va += PGSIZE) {
+        struct page *page;
+        bool ok = true;
+
+        lock_acquire(&spt->lock);
+        page = spt_find_page(spt, va);
+        if (page != NULL && page->frame == NULL)
+            ok = vm_prefetch_page(page);
+        lock_release(&spt->lock);
+        if (!ok)
+            break;
+    }
+}
+
+static void
+prefetchd(void *aux UNUSED) {
+    for (;;) {
+        struct prefetch_req *req;
+
+        lock_acquire(&prefetch_lock);
+        while (list_empty(&prefetch_queue))
+            cond_wait(&prefetch_work, &prefetch_lock);
+        req = list_entry(list_pop_front(&prefetch_queue), struct prefetch_req, elem);
+        prefetch_busy = req->owner;
+        lock_release(&prefetch_lock);
+
+        prefetch_range(req);
+
+        lock_acquire(&prefetch_lock);
+        prefetch_busy = NULL;
+        cond_broadcast(&prefetch_done, &prefetch_lock);
+        lock_release(&prefetch_lock);
+        free(req);
+    }
+}
+
+/* Drops the pending prefetch requests of T and waits for the one in
+ * progress, if it is T's.  Called before T's address space goes away.
+ * T must not hold its spt lock. */
+void madvise_cancel(struct thread *t) {
+    struct list_elem *e;
+
+    lock_acquire(&prefetch_lock);
+    for (e = list_begin(&prefetch_queue); e != list_end(&prefetch_queue);) {
+        struct prefetch_req *req = list_entry(e, struct prefetch_req, elem);
+
+        if (req->owner == t) {
+            e = list_remove(e);
+            free(req);
+        } else
+            e = list_next(e);
+    }
+    while (prefetch_busy == t)
+        cond_wait(&prefetch_done, &prefetch_lock);
+    lock_release(&prefetch_lock);
+}
+
+/* Applies ADVICE to the pages of the current process in [ADDR,
+ * ADDR + LENGTH).  ADDR must be page-aligned; unmapped pages in the
+ * range are ignored.  Returns 0 on success, -1 on a bad argument. */
+int do_madvise(void *addr, size_t length, int advice) {
+    struct supplemental_page_table *spt = &thread_current()->spt;
+    uint8_t *start = addr, *end;
+    struct prefetch_req *req;
+
+    if (start == NULL || pg_ofs(start) != 0 || length == 0)
+        return -1;
+    end = pg_round_up(start + length);
+    if (end <= start || !is_user_vaddr(end - 1))
+        return -1;
+
+    switch (advice) {
+    case MADV_NORMAL:
+    case MADV_RANDOM:
+    case MADV_SEQUENTIAL:
+    case MADV_DONTNEED:
+        lock_acquire(&spt->lock);
+        for (uint8_t *va = start; va < end; va += PGSIZE) {
+            struct page *page = spt_find_page(spt, va);
+
+            if (page == NULL)
+                continue;
+            if (advice == MADV_DONTNEED)
+                vm_discard_page(page);
+            else
+                page->advice = advice;
+        }
+        lock_release(&spt->lock);
+        return 0;
+
+    case MADV_WILLNEED:
+        req = malloc(sizeof *req);
+        if (req == NULL)
+            return -1;
+        req->owner = thread_current();
+        req->start = start;
+        req->end = end;
+
+        lock_acquire(&prefetch_lock);
+        list_push_back(&prefetch_queue, &req->elem);
+        cond_signal(&prefetch_work, &prefetch_lock);
+        lock_release(&prefetch_lock);
+        return 0;
+
+    default:
+        return -1;
+    }
+}
@@ -0,0 +1,125 @@
+/* rss.c: Resident-set accounting, limits and working-set sampling.
+ *
+ * Each page mapped to a frame is charged to its owner's rss.  A process
+ * whose rss has reached its limit replaces one of its own pages on the
+ * next fault instead of taking a frame from the pool, and its pages are
+ * the first to go when another process needs one, so a single process
+ * cannot push everyone else out of memory.  When enabled with -wss,
+ * wssd samples and clears the accessed bits of the resident pages every
+ * wss_interval ticks and reports the number it found set as each
+ * owner's working set. */
+
+#include "vm/rss.h"
+#include "vm/vm.h"
+#include "devices/timer.h"
+#include "threads/interrupt.h"
+#include "threads/mmu.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include <stdio.h>
+
+size_t rss_default_limit;
+int wss_interval;
+
+extern struct frame *frame_table;
+extern size_t frame_table_size;
+extern struct lock frame_table_lock;
+
+/* Statistics. */
+static long long rss_self_evictions; /* Faults that replaced an own page. */
+static long long wss_samples;        /* Completed working-set samples. */
+
+static void wssd(void *aux UNUSED);
+
+void rss_init(void) {
+    if (wss_interval > 0)
+        thread_create("wssd", PRI_MIN, wssd, NULL);
+}
+
+/* Adds DELTA pages to the resident set of T.  Pages are charged and
+ * uncharged by whichever thread maps or evicts them, hence the
+ * interrupt masking. */
+void rss_charge(struct thread *t, int delta) {
+    enum intr_level old_level = intr_disable();
+
+    t->rss += delta;
+    intr_set_level(old_level);
+}
+
+/* Returns true if T has as many resident pages as it may have. */
+bool rss_over_limit(struct thread *t) {
+    return t->rss_limit != 0 && t->rss >= t->rss_limit;
+}
+
+void rss_note_self_eviction(void) {
+    rss_self_evictions++;
+}
+
+/* Sets the resident-set limit of the current process to PAGES, 0 for
+ * none.  The limit is inherited by fork and kept across exec.  A
+ * process above its new limit shrinks as it faults. */
+int rss_set_limit(size_t pages) {
+    thread_current()->rss_limit = pages;
+    return 0;
+}
+
+/* Stores the memory use of the current process in BUF. */
+int rss_query(struct mem_usage *buf) {
+    struct thread *t = thread_current();
+
+    buf->rss = t->rss;
+    buf->rss_limit = t->rss_limit;
+    buf->wss = t->wss < t->rss ? t->wss : t->rss;
+    buf->huge_faults = t->huge_faults;
+    return 0;
+}
+
+/* Counts the recently accessed pages of every process with resident
+ * pages and clears their accessed bits for the next sample. */
+static void
+wss_sample(void) {
+    size_t i;
+
+    lock_acquire(&frame_table_lock);
+    for (i = 0; i < frame_table_size; i++)
+        if (frame_table[i].ref_cnt != 0 && frame_table[i].page != NULL)
+            frame_table[i].page->owner->wss_scan = 0;
+
+    for (i = 0; i < frame_table_size; i++) {
+        struct page *page = frame_table[i].page;
+
+        if (frame_table[i].ref_cnt == 0 || page == NULL)
+            continue;
+        if (pte_is_accessed(vm_page_pte(page)))
+            page->owner->wss_scan++;
+    }
+
+    /* Cleared in a pass of their own, since the frames of a 2 MB page
+     * share one accessed bit. */
+    for (i = 0; i < frame_table_size; i++) {
+        struct page *page = frame_table[i].page;
+        uint64_t *pte;
+
+        if (frame_table[i].ref_cnt == 0 || page == NULL)
+            continue;
+        pte = vm_page_pte(page);
+        if (pte != NULL)
+            pte_set_accessed(page->owner->pml4, pte, page->va, false);
+        page->owner->wss = page->owner->wss_scan;
+    }
+    wss_samples++;
+    lock_release(&frame_table_lock);
+}
+
+static void
+wssd(void *aux UNUSED) {
+    for (;;) {
+        timer_sleep(wss_interval);
+        wss_sample();
+    }
+}
+
+void rss_print_stats(void) {
+    printf("rss: %lld self-evictions, %lld working-set samples\n",
+           rss_self_evictions, wss_samples);
+}
@@ -0,0 +1,180 @@
+/* share.c: File pages shared between processes.
+ *
+ * Frames that hold a read-only page of an executable are indexed by the
+ * executable's inode and the file offset of the page.  When another
+ * process faults on the same page of the same binary, it maps the cached
+ * frame instead of reading its own copy, so N instances of one program
+ * share one physical copy of its code.  A frame leaves the index when it
+ * is evicted or freed by its last user.
+ *
+ * Pages of MAP_SHARED file mappings are indexed the same way, but there
+ * the index is what makes the mapping shared: every mapper of a file
+ * page maps the one indexed frame, writable if its mapping is, so the
+ * mappers see each other's writes and memory grows with the number of
+ * distinct file pages rather than with the number of mappers. */
+
+#include "vm/share.h"
+#include "vm/vm.h"
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/mmu.h"
+#include "threads/thread.h"
+#include "userprog/process.h"
+#include <hash.h>
+#include <stdio.h>
+
+extern struct lock frame_table_lock;
+
+/* One cached frame. */
+struct share_entry {
+    struct inode *inode; /* Inode of the executable or mapped file. */
+    off_t offset;        /* File offset of the page. */
+    bool mapped;         /* Page of a MAP_SHARED mapping, not text. */
+    struct frame *frame; /* Frame holding the page. */
+    struct hash_elem elem;
+};
+
+/* Cached frames keyed by (inode, offset).
+ * Protected by frame_table_lock. */
+static struct hash share_table;
+
+/* Statistics. */
+static long long share_hits;     /* Text faults served from the cache. */
+static long long share_map_hits; /* Shared-mapping faults served likewise. */
+
+static uint64_t
+share_hash(const struct hash_elem *e, void *aux UNUSED) {
+    const struct share_entry *entry = hash_entry(e, struct share_entry, elem);
+    return hash_bytes(&entry->inode, sizeof entry->inode) ^ hash_int(entry->offset) ^ entry->mapped;
+}
+
+static bool
+share_less(const struct hash_elem *a_, const struct hash_elem *b_, void *aux UNUSED) {
+    const struct share_entry *a = hash_entry(a_, struct share_entry, elem);
+    const struct share_entry *b = hash_entry(b_, struct share_entry, elem);
+
+    if (a->inode != b->inode)
+        return a->inode < b->inode;
+    if (a->offset != b->offset)
+        return a->offset < b->offset;
+    return a->mapped < b->mapped;
+}
+
+void share_init(void) {
+    hash_init(&share_table, share_hash, share_less, NULL);
+}
+
+/* Fills KEY with the cache key of PAGE and returns true if PAGE is a
+ * read-only executable page that has not been loaded yet, or a page of
+ * a MAP_SHARED file mapping. */
+static bool
+share_key(struct page *page, struct share_entry *key) {
+    struct load_aux *aux = page->uninit.aux;
+    enum vm_type type;
+
+    if (page->operations->type == VM_FILE)
+        type = VM_FILE;
+    else if (page->operations->type == VM_UNINIT && page->uninit.init == lazy_load_segment)
+        type = VM_TYPE(page->uninit.type);
+    else
+        return false;
+    if (type == VM_FILE ? !aux->shared : page->writable)
+        return false;
+
+    key->inode = file_get_inode(aux->file);
+    key->offset = aux->offset;
+    key->mapped = type == VM_FILE;
+    return true;
+}
+
+/* Maps PAGE to a cached frame holding the same page of the same
+ * executable or shared mapping.  Returns false if there is none, in
+ * which case the caller loads the page itself. */
+bool share_claim(struct page *page) {
+    struct share_entry key;
+    struct frame *frame;
+    struct hash_elem *e;
+    bool busy;
+
+    if (!share_key(page, &key))
+        return false;
+
+    lock_acquire(&frame_table_lock);
+    for (;;) {
+        e = hash_find(&share_table, &key.elem);
+        frame = e != NULL ? hash_entry(e, struct share_entry, elem)->frame : NULL;
+        busy = frame != NULL && frame->pinned;
+
+        /* A pinned frame is being filled.  A text page can be read
+         * privately instead, but a shared mapping has to wait, or its
+         * mappers would end up with copies of their own. */
+        if (!busy || !key.mapped)
+            break;
+        vm_wait_unpinned();
+    }
+    if (frame != NULL && !busy)
+        frame->ref_cnt++;
+    lock_release(&frame_table_lock);
+    if (frame == NULL || busy)
+        return false;
+
+    vm_set_frame(page, frame);
+    if (!vm_map_page(page, frame->kva, page->writable)) {
+        vm_release_frame(page);
+        return false;
+    }
+    if (page->operations->type == VM_UNINIT) {
+        /* Transmute without running the loader. */
+        page->uninit.page_initializer(page, page->uninit.type, frame->kva);
+    }
+    if (key.mapped)
+        share_map_hits++;
+    else
+        share_hits++;
+    return true;
+}
+
+/* Adds the frame of PAGE to the cache if PAGE is a read-only executable
+ * page or a page of a shared mapping.  Call while the frame is still
+ * pinned and before PAGE is loaded, as loading replaces the information
+ * the cache key is built from.  Returns false if PAGE belongs to a
+ * shared mapping whose page another process has brought in meanwhile;
+ * the caller must then give up its frame and claim that one. */
+bool share_register(struct page *page) {
+    struct share_entry *entry = malloc(sizeof *entry);
+    bool lost = false;
+
+    if (entry == NULL)
+        return true;
+    if (!share_key(page, entry)) {
+        free(entry);
+        return true;
+    }
+    entry->frame = page->frame;
+
+    lock_acquire(&frame_table_lock);
+    if (entry->frame->share == NULL && hash_insert(&share_table, &entry->elem) == NULL)
+        entry->frame->share = entry;
+    else {
+        lost = entry->mapped && entry->frame->share == NULL;
+        free(entry);
+    }
+    lock_release(&frame_table_lock);
+    return !lost;
+}
+
+/* Removes FRAME from the cache.  Caller must hold frame_table_lock. */
+void share_forget(struct frame *frame) {
+    struct share_entry *entry = frame->share;
+
+    if (entry == NULL)
+        return;
+    hash_delete(&share_table, &entry->elem);
+    frame->share = NULL;
+    free(entry);
+}
+
+void share_print_stats(void) {
+    printf("share: %lld text and %lld shared-mapping page faults served from %zu shared frames\n",
+           share_hits, share_map_hits, hash_size(&share_table));
+}
@@ -0,0 +1,415 @@
+/* shm.c: Shared memory segments.
+ *
+ * A segment is a run of anonymous pages that any process can attach to
+ * its address space by the segment's id.  Each page of a segment has at
+ * most one frame, which every attached process maps, so the processes
+ * see each other's writes without copying.  The segment holds a
+ * reference to each of its resident frames, and the pages of the
+ * processes that map a frame are kept on a list, so that the frame can
+ * be unmapped from all of them and swapped out as a whole.
+ *
+ * A segment lives while it is attached somewhere or its creator is
+ * still running.  Attachments are anonymous mappings (see vm/heap.c),
+ * so they are inherited by fork() and removed by munmap() and exit. */
+
+#include "vm/shm.h"
+#include "vm/heap.h"
+#include "vm/vm.h"
+#include "bitmap.h"
+#include "threads/malloc.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+#include <round.h>
+#include <string.h>
+
+extern struct lock frame_table_lock;
+
+/* One page of a segment. */
+struct shm_slot {
+    struct shm_segment *seg; /* Segment the page belongs to. */
+    struct frame *frame;     /* Frame holding the page, or NULL. */
+    size_t swap_slot;        /* Swap slot while swapped out, or BITMAP_ERROR. */
+    struct list mappers;     /* Pages that map FRAME, by shm.elem. */
+};
+
+/* A shared memory segment. */
+struct shm_segment {
+    int id;                  /* Identifier passed to shm_attach(). */
+    int ref_cnt;             /* Attachments, plus one while CREATOR runs. */
+    struct thread *creator;  /* Creating process, NULL once it exited. */
+    struct lock lock;        /* Protects the slots. */
+    struct list_elem elem;   /* In segments. */
+    size_t page_cnt;         /* Number of pages. */
+    struct shm_slot slots[]; /* One per page. */
+};
+
+static bool shm_swap_in(struct page *page, void *kva);
+static bool shm_page_swap_out(struct page *page);
+static void shm_destroy(struct page *page);
+
+static const struct page_operations shm_ops = {
+    .swap_in = shm_swap_in,
+    .swap_out = shm_page_swap_out,
+    .destroy = shm_destroy,
+    .type = VM_SHM,
+};
+
+static struct list segments; /* All live segments. */
+static struct lock shm_lock; /* Protects segments, ids and ref_cnts. */
+static int next_id;          /* Id of the next segment. */
+
+void shm_init(void) {
+    list_init(&segments);
+    lock_init(&shm_lock);
+}
+
+/* Creates a zero-filled segment of SIZE bytes, rounded up to whole
+ * pages.  Returns its id, or -1 if SIZE is 0 or too large or memory is
+ * short. */
+int shm_create(size_t size) {
+    size_t page_cnt = DIV_ROUND_UP(size, PGSIZE);
+    struct shm_segment *seg;
+
+    if (size == 0 || page_cnt > SHM_MAX_PAGES)
+        return -1;
+    seg = malloc(sizeof *seg + page_cnt * sizeof *seg->slots);
+    if (seg == NULL)
+        return -1;
+
+    seg->ref_cnt = 1;
+    seg->creator = thread_current();
+    lock_init(&seg->lock);
+    seg->page_cnt = page_cnt;
+    for (size_t i = 0; i < page_cnt; i++) {
+        seg->slots[i].seg = seg;
+        seg->slots[i].frame = NULL;
+        seg->slots[i].swap_slot = BITMAP_ERROR;
+        list_init(&seg->slots[i].mappers);
+    }
+
+    lock_acquire(&shm_lock);
+    seg->id = next_id++;
+    list_push_back(&segments, &seg->elem);
+    lock_release(&shm_lock);
+    return seg->id;
+}
+
+/* Returns the segment with id ID with a new reference to it, or NULL. */
+static struct shm_segment *
+shm_lookup(int id) {
+    struct list_elem *e;
+
+    lock_acquire(&shm_lock);
+    for (e = list_begin(&segments); e != list_end(&segments); e = list_next(e)) {
+        struct shm_segment *seg = list_entry(e, struct shm_segment, elem);
+
+        if (seg->id == id) {
+            seg->ref_cnt++;
+            lock_release(&shm_lock);
+            return seg;
+        }
+    }
+    lock_release(&shm_lock);
+    return NULL;
+}
+
+void shm_get(struct shm_segment *seg) {
+    lock_acquire(&shm_lock);
+    seg->ref_cnt++;
+    lock_release(&shm_lock);
+}
+
+/* Frees SEG, which nothing refers to any more: its frames go back to
+ * the user pool and its swap slots are released.  A frame being
+ * evicted is waited for, without the segment lock that the eviction
+ * needs, so that the eviction is done with SEG. */
+static void
+shm_free(struct shm_segment *seg) {
+    for (size_t i = 0; i < seg->page_cnt; i++) {
+        struct shm_slot *slot = &seg->slots[i];
+
+        for (;;) {
+            lock_acquire(&seg->lock);
+            lock_acquire(&frame_table_lock);
+            if (slot->frame == NULL || !slot->frame->pinned)
+                break;
+            lock_release(&seg->lock);
+            vm_wait_unpinned();
+            lock_release(&frame_table_lock);
+        }
+        if (slot->frame != NULL) {
+            slot->frame->shm = NULL;
+            vm_put_frame(slot->frame);
+            slot->frame = NULL;
+        }
+        lock_release(&frame_table_lock);
+        if (slot->swap_slot != BITMAP_ERROR)
+            anon_swap_free(slot->swap_slot);
+        lock_release(&seg->lock);
+    }
+    free(seg);
+}
+
+/* Drops a reference to SEG, freeing it with the last one. */
+void shm_put(struct shm_segment *seg) {
+    bool last;
+
+    lock_acquire(&shm_lock);
+    last = --seg->ref_cnt == 0;
+    if (last)
+        list_remove(&seg->elem);
+    lock_release(&shm_lock);
+    if (last)
+        shm_free(seg);
+}
+
+/* Attaches segment ID to the current process at ADDR, or where the
+ * kernel chooses if ADDR is NULL.  FLAGS are the MAP_* bits of mmap().
+ * Returns the address of the attachment, or NULL. */
+void *shm_attach(int id, void *addr, int flags) {
+    struct shm_segment *seg;
+    void *start;
+
+    if (addr != NULL && !is_user_vaddr(addr))
+        return NULL;
+    seg = shm_lookup(id);
+    if (seg == NULL)
+        return NULL;
+    if (addr != NULL && !is_user_vaddr((uint8_t *)addr + seg->page_cnt * PGSIZE - 1)) {
+        shm_put(seg);
+        return NULL;
+    }
+    start = heap_map(addr, seg->page_cnt * PGSIZE, flags, seg);
+    if (start == NULL)
+        shm_put(seg);
+    return start;
+}
+
+/* Detaches the segment attached at ADDR from the current process.
+ * Returns 0 on success, -1 if no segment is attached there. */
+int shm_detach(void *addr) {
+    return heap_unmap(addr, true) ? 0 : -1;
+}
+
+/* Drops the references that T holds as the creator of segments. */
+void shm_exit(struct thread *t) {
+    for (;;) {
+        struct shm_segment *seg = NULL;
+        struct list_elem *e;
+
+        lock_acquire(&shm_lock);
+        for (e = list_begin(&segments); e != list_end(&segments); e = list_next(e))
+            if (list_entry(e, struct shm_segment, elem)->creator == t) {
+                seg = list_entry(e, struct shm_segment, elem);
+                seg->creator = NULL;
+                break;
+            }
+        lock_release(&shm_lock);
+        if (seg == NULL)
+            return;
+        shm_put(seg);
+    }
+}
+
+/* Adds the page at VA of the current process through which it sees
+ * page IDX of SEG.  Returns false if VA is in use or memory is short.
+ * Caller holds the spt lock. */
+bool shm_add_page(struct shm_segment *seg, size_t idx, void *va, bool writable) {
+    struct supplemental_page_table *spt = &thread_current()->spt;
+    struct page *page;
+
+    if (spt_find_page(spt, va) != NULL)
+        return false;
+    page = calloc(1, sizeof *page);
+    if (page == NULL)
+        return false;
+
+    page->operations = &shm_ops;
+    page->va = va;
+    page->owner = thread_current();
+    page->writable = writable;
+    page->slot_no = BITMAP_ERROR;
+    page->shm.seg = seg;
+    page->shm.idx = idx;
+    if (!spt_insert_page(spt, page)) {
+        free(page);
+        return false;
+    }
+    return true;
+}
+
+/* Adds to the current process, a child being forked, its own page for
+ * the segment page that its parent's PAGE shows. */
+bool shm_copy_page(struct page *page) {
+    return shm_add_page(page->shm.seg, page->shm.idx, page->va, page->writable);
+}
+
+/* Maps segment page PAGE to the frame of the segment that holds it.
+ * Returns false if the segment page is not resident, in which case the
+ * caller brings it in. */
+bool shm_claim(struct page *page) {
+    struct shm_segment *seg;
+    struct shm_slot *slot;
+    struct frame *frame;
+
+    if (page->operations->type != VM_SHM)
+        return false;
+
+    seg = page->shm.seg;
+    slot = &seg->slots[page->shm.idx];
+    for (;;) {
+        lock_acquire(&seg->lock);
+        lock_acquire(&frame_table_lock);
+        frame = slot->frame;
+
+        /* A pinned frame is being filled or swapped out, which needs
+         * the segment lock. */
+        if (frame == NULL || !frame->pinned)
+            break;
+        lock_release(&seg->lock);
+        vm_wait_unpinned();
+        lock_release(&frame_table_lock);
+    }
+    if (frame != NULL)
+        frame->ref_cnt++;
+    lock_release(&frame_table_lock);
+    if (frame == NULL) {
+        lock_release(&seg->lock);
+        return false;
+    }
+
+    vm_set_frame(page, frame);
+    if (!vm_map_page(page, frame->kva, page->writable)) {
+        vm_set_frame(page, NULL);
+        free_frame(frame);
+        lock_release(&seg->lock);
+        return false;
+    }
+    list_push_back(&slot->mappers, &page->shm.elem);
+    lock_release(&seg->lock);
+    return true;
+}
+
+/* Makes the pinned frame of segment page PAGE the frame of the segment
+ * page, before PAGE is mapped and its contents are read in.  Returns
+ * false if another process brought the segment page in meanwhile; the
+ * caller must then give up its frame and claim that one. */
+bool shm_register(struct page *page) {
+    struct shm_segment *seg;
+    struct shm_slot *slot;
+    struct frame *frame = page->frame;
+
+    if (page->operations->type != VM_SHM)
+        return true;
+
+    seg = page->shm.seg;
+    slot = &seg->slots[page->shm.idx];
+    lock_acquire(&seg->lock);
+    if (slot->frame != NULL) {
+        lock_release(&seg->lock);
+        return false;
+    }
+    lock_acquire(&frame_table_lock);
+    slot->frame = frame;
+    frame->shm = slot;
+    frame->page = NULL;
+    frame->ref_cnt++;
+    lock_release(&frame_table_lock);
+    list_push_back(&slot->mappers, &page->shm.elem);
+    lock_release(&seg->lock);
+    return true;
+}
+
+/* Reads the contents of segment page PAGE into KVA, the frame that
+ * shm_register() gave the segment page. */
+static bool
+shm_swap_in(struct page *page, void *kva) {
+    struct shm_segment *seg = page->shm.seg;
+    struct shm_slot *slot = &seg->slots[page->shm.idx];
+
+    lock_acquire(&seg->lock);
+    if (slot->swap_slot != BITMAP_ERROR) {
+        anon_swap_read(slot->swap_slot, kva);
+        slot->swap_slot = BITMAP_ERROR;
+    } else
+        memset(kva, 0, PGSIZE);
+    lock_release(&seg->lock);
+    return true;
+}
+
+/* Segment pages are swapped out frame by frame with shm_swap_out(). */
+static bool
+shm_page_swap_out(struct page *page UNUSED) {
+    return false;
+}
+
+/* Swaps out segment frame FRAME, which the caller has pinned: unmaps it
+ * from every process that maps it and writes it to swap.  Each mapping
+ * is removed under its owner's spt lock; an owner that holds it already
+ * is not waited for.  Returns false if such an owner was found or swap
+ * is full; the frame then stays with the segment, and the mappings
+ * removed already are restored by the next fault. */
+bool shm_swap_out(struct frame *frame) {
+    struct shm_slot *slot = frame->shm;
+    struct shm_segment *seg = slot->seg;
+    size_t slot_no;
+
+    lock_acquire(&seg->lock);
+    /* Unmap first, so that nobody writes to the frame while it is saved. */
+    while (!list_empty(&slot->mappers)) {
+        struct page *page = list_entry(list_front(&slot->mappers), struct page, shm.elem);
+        struct lock *spt_lock = &page->owner->spt.lock;
+        bool held = lock_held_by_current_thread(spt_lock);
+
+        if (!held && !lock_try_acquire(spt_lock)) {
+            lock_release(&seg->lock);
+            return false;
+        }
+        list_remove(&page->shm.elem);
+        vm_unmap_page(page);
+        vm_set_frame(page, NULL);
+        if (!held)
+            lock_release(spt_lock);
+        lock_acquire(&frame_table_lock);
+        frame->ref_cnt--;
+        lock_release(&frame_table_lock);
+    }
+
+    slot_no = anon_swap_write(frame->kva);
+    if (slot_no != BITMAP_ERROR) {
+        slot->swap_slot = slot_no;
+        slot->frame = NULL;
+        frame->shm = NULL;
+    }
+    lock_release(&seg->lock);
+    return slot_no != BITMAP_ERROR;
+}
+
+/* Removes PAGE from the segment page it shows.  PAGE will be freed by
+ * the caller.  A frame being swapped out is waited for without holding
+ * the segment lock, which the swap-out needs; it fails on PAGE's owner,
+ * whose spt lock the caller holds. */
+static void
+shm_destroy(struct page *page) {
+    struct shm_segment *seg = page->shm.seg;
+    struct frame *frame;
+
+    for (;;) {
+        lock_acquire(&seg->lock);
+        lock_acquire(&frame_table_lock);
+        frame = page->frame;
+        if (frame == NULL || !frame->pinned)
+            break;
+        lock_release(&seg->lock);
+        vm_wait_unpinned();
+        lock_release(&frame_table_lock);
+    }
+    if (frame != NULL) {
+        list_remove(&page->shm.elem);
+        vm_unmap_page(page);
+        vm_set_frame(page, NULL);
+        vm_put_frame(frame);
+    }
+    lock_release(&frame_table_lock);
+    lock_release(&seg->lock);
+}
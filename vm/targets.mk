@@ -3,3 +3,14 @@ vm_SRC += vm/uninit.c     # Uninitialized page
 vm_SRC += vm/anon.c       # Anonymous page
 vm_SRC += vm/file.c       # File mapped page
 vm_SRC += vm/inspect.c    # Testing utility
+vm_SRC += vm/zswap.c      # Compressed swap cache
+vm_SRC += vm/ksm.c        # Same-page merging
+vm_SRC += vm/share.c      # Shared executable pages
+vm_SRC += vm/madvise.c    # Access-pattern advice
+vm_SRC += vm/faultstat.c  # Page fault statistics
+vm_SRC += vm/kswapd.c     # Background page reclaim
+vm_SRC += vm/rss.c        # Resident-set limits
+vm_SRC += vm/loadctl.c    # Thrashing load control
+vm_SRC += vm/hugepage.c   # Transparent 2 MB pages
+vm_SRC += vm/heap.c       # Program break and anonymous mappings
+vm_SRC += vm/shm.c        # Shared memory segments
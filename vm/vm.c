@@ -1,17 +1,47 @@
 /* vm.c: Generic interface for virtual memory objects. */
 
 #include "vm/vm.h"
+#include "bitmap.h"
 #include "threads/malloc.h"
 #include "vm/inspect.h"
+#include "vm/faultstat.h"
+#include "vm/heap.h"
+#include "vm/hugepage.h"
+#include "vm/ksm.h"
+#include "vm/kswapd.h"
+#include "vm/loadctl.h"
+#include "vm/madvise.h"
+#include "vm/rss.h"
+#include "vm/share.h"
+#include "vm/zswap.h"
 #include "include/lib/kernel/hash.h"
 #include "include/threads/vaddr.h"
+#include "intrinsic.h"
 #include "threads/mmu.h"
 #include "string.h"
 #include "userprog/process.h"
-
-struct list frame_table;
+#include <mman.h>
+#include <round.h>
+#include <stdio.h>
+
+/* Frame descriptors for every page of the user pool, in address order.
+ * Descriptors of free pages have ref_cnt == 0. */
+struct frame *frame_table;
+size_t frame_table_size;
 struct lock frame_table_lock;
+static struct condition frame_unpinned; /* Signalled when a frame is unpinned. */
+static uint8_t *frame_base;  /* Kernel address of frame_table[0]. */
+static size_t clock_hand;    /* Next frame_table index to inspect. */
+static long long direct_reclaims; /* Evictions done by faulting threads. */
+static long long busy_victims;    /* Victims skipped for a busy owner. */
+
+/* Bytes of file-backed neighbours mapped around a fault, 0 to disable. */
+size_t fault_around_bytes = FAULT_AROUND_DEFAULT;
+
+/* If true, load() faults in every page of the executable up front. */
+bool vm_prefault_exec;
 void destructor(struct hash_elem *e, void *aux);
+static void vm_frame_table_init(void);
 /* Initializes the virtual memory subsystem by invoking each subsystem's
  * intialize codes. */
 void vm_init(void) {
@@ -23,8 +53,36 @@ void vm_init(void) {
     register_inspect_intr();
     /* DO NOT MODIFY UPPER LINES. */
     /* TODO: Your code goes here. */
-    list_init(&frame_table);
+    vm_frame_table_init();
     lock_init(&frame_table_lock);
+    cond_init(&frame_unpinned);
+    ksm_init();
+    share_init();
+    shm_init();
+    madvise_init();
+    faultstat_init();
+    kswapd_init();
+    rss_init();
+    loadctl_init();
+}
+
+/* Allocates a descriptor for every page of the user pool. */
+static void vm_frame_table_init(void) {
+    size_t bytes;
+
+    palloc_user_range((void **)&frame_base, &frame_table_size);
+    bytes = frame_table_size * sizeof *frame_table;
+    frame_table = palloc_get_multiple(PAL_ASSERT | PAL_ZERO, DIV_ROUND_UP(bytes, PGSIZE));
+    for (size_t i = 0; i < frame_table_size; i++)
+        frame_table[i].kva = frame_base + i * PGSIZE;
+}
+
+/* Returns the descriptor of the user pool page at KVA. */
+struct frame *vm_kva_to_frame(void *kva) {
+    size_t idx = ((uint8_t *)kva - frame_base) / PGSIZE;
+
+    ASSERT(idx < frame_table_size);
+    return &frame_table[idx];
 }
 
 /* Get the type of the page. This function is useful if you want to know the
@@ -42,9 +100,12 @@ page_get_type(struct page *page) {
 }
 
 /* Helpers */
-static struct frame *vm_get_victim(void);
+static struct frame *vm_get_victim(struct thread *owner, struct lock **spt_lock);
 static bool vm_do_claim_page(struct page *page);
-static struct frame *vm_evict_frame(void);
+static bool vm_map_frame(struct page *page, struct frame *frame);
+static void vm_fault_around(struct page *page, struct load_aux *aux);
+static struct load_aux *vm_file_aux(struct page *page);
+static struct frame *vm_evict_frame(struct thread *owner);
 
 /* Create the pending page object with initializer. If you want to create a
  * page, do not create it directly and make it through this function or
@@ -67,6 +128,8 @@ bool vm_alloc_page_with_initializer(enum vm_type type, void *upage, bool writabl
             uninit_new(page, upage, init, type, aux, file_backed_initializer);
 
         page->writable = writable;
+        page->owner = thread_current();
+        page->slot_no = BITMAP_ERROR;
 
         return spt_insert_page(spt, page);
     }
@@ -76,15 +139,11 @@ err:
 
 /* Find VA from spt and return page. On error, return NULL. */
 struct page *spt_find_page(struct supplemental_page_table *spt UNUSED, void *va UNUSED) {
-    struct page *page = NULL;
+    struct page page;
     struct hash_elem *e;
 
-    page = malloc(sizeof(struct page));
-
-    page->va = pg_round_down(va);
-    e = hash_find(&spt->hash_spt, &page->hash_elem);
-
-    free(page); //?다시 생각해보기
+    page.va = pg_round_down(va);
+    e = hash_find(&spt->hash_spt, &page.hash_elem);
 
     return e != NULL ? hash_entry(e, struct page, hash_elem) : NULL;
 }
@@ -102,124 +161,363 @@ void spt_remove_page(struct supplemental_page_table *spt, struct page *page) {
     return true;
 }
 
-/* Get the struct frame, that will be evicted. */
-static struct frame *vm_get_victim(void) {
+/* Returns true if FRAME may be chosen for eviction: it holds exactly one
+ * page and is not pinned.  Shared frames (copy-on-write, merged by ksmd)
+ * stay resident because the other mappings cannot be updated here.
+ * Caller must hold frame_table_lock. */
+static bool vm_frame_evictable(struct frame *frame) {
+    return frame->page != NULL && !frame->pinned && frame->ref_cnt == 1;
+}
+
+/* Takes the spt lock of the owner of FRAME's page for its eviction,
+ * unless the current thread holds it already, and stores the lock taken
+ * or NULL in *SPT_LOCK.  Returns false if another thread holds it: the
+ * owner may be changing or destroying its pages.  The owner cannot be
+ * waited for, as it may itself wait for a frame.  Caller must hold
+ * frame_table_lock. */
+static bool vm_lock_victim(struct frame *frame, struct lock **spt_lock) {
+    struct lock *lock = &frame->page->owner->spt.lock;
+
+    *spt_lock = NULL;
+    if (lock_held_by_current_thread(lock))
+        return true;
+    if (!lock_try_acquire(lock)) {
+        busy_victims++;
+        return false;
+    }
+    *spt_lock = lock;
+    return true;
+}
+
+/* Get the struct frame, that will be evicted, among the frames of OWNER
+ * or of any process if OWNER is NULL.  Pages of processes above their
+ * resident-set limit are taken first.  Pages whose owner is busy with
+ * its spt are skipped.
+ * The chosen frame is returned pinned, with its owner's spt lock held;
+ * *SPT_LOCK is set to that lock if it was taken here, else NULL. */
+static struct frame *vm_get_victim(struct thread *owner, struct lock **spt_lock) {
     struct frame *victim = NULL;
-    struct thread *curr = thread_current();
 
+    *spt_lock = NULL;
     lock_acquire(&frame_table_lock);
 
-    for (struct list_elem *e = list_begin(&frame_table); e != list_end(&frame_table); e = list_next(e)) {
-        victim = list_entry(e, struct frame, frame_elem);
-        if (victim->page == NULL) // frame에 할당된 페이지가 없는 경우 (page가 destroy된 경우 )
-        {
-            lock_release(&frame_table_lock);
-            return victim;
+    /* Two sweeps of the clock hand: the first clears accessed bits, so
+     * the second finds a victim unless every frame is unevictable. */
+    for (size_t n = 0; n < 2 * frame_table_size; n++) {
+        struct frame *frame = &frame_table[clock_hand];
+
+        clock_hand = (clock_hand + 1) % frame_table_size;
+
+        /* A segment frame has no single accessed bit to consult, so it
+         * is only taken once a full sweep found nothing else. */
+        if (frame->shm != NULL && !frame->pinned && owner == NULL && n >= frame_table_size) {
+            victim = frame;
+            break;
         }
-        if (pml4_is_accessed(curr->pml4, victim->page->va))
-            pml4_set_accessed(curr->pml4, victim->page->va, 0);
-        else {
-            lock_release(&frame_table_lock);
-            return victim;
+        if (!vm_frame_evictable(frame))
+            continue;
+        if (owner != NULL && frame->page->owner != owner)
+            continue;
+
+        /* Pages advised sequential are not expected to be reused. */
+        uint64_t *pte = vm_page_pte(frame->page);
+        if (owner == NULL && rss_over_limit(frame->page->owner)) {
+            if (!vm_lock_victim(frame, spt_lock))
+                continue;
+            victim = frame;
+            break;
         }
+        if (frame->page->advice != MADV_SEQUENTIAL && pte_is_accessed(pte)) {
+            pte_set_accessed(frame->page->owner->pml4, pte, frame->page->va, 0);
+
+            /* The frames of a 2 MB page share one accessed bit. */
+            if (frame->huge) {
+                size_t idx = frame - frame_table;
+                size_t ofs = ((uint64_t)frame->page->va & (HPGSIZE - 1)) / PGSIZE;
+                clock_hand = (idx - ofs + HPAGE_PAGES) % frame_table_size;
+            }
+        } else if (vm_lock_victim(frame, spt_lock)) {
+            victim = frame;
+            break;
+        }
+    }
+    if (victim != NULL) {
+        victim->pinned = true;
+        share_forget(victim);
     }
     lock_release(&frame_table_lock);
     return victim;
 }
 
-/* Evict one page and return the corresponding frame.
- * Return NULL on error.*/
-static struct frame *vm_evict_frame(void) {
-    struct frame *victim = vm_get_victim();
-    /* TODO: swap out the victim and return the evicted frame. */
-    if (swap_out(victim->page)) {
-        victim->page = NULL;
-        memset(victim->kva, 0, PGSIZE);
-        victim->ref_cnt = 1;
-        return victim;
+/* Collects the cluster of anonymous pages to swap out together with
+ * VICTIM: VICTIM itself followed by the resident, unshared and recently
+ * unused anonymous pages that directly follow it in the owner's address
+ * space.  The frames of the collected neighbours are pinned.  Caller
+ * holds the owner's spt lock.
+ * Returns the number of pages stored in CLUSTER. */
+static size_t vm_gather_swap_cluster(struct page *victim, struct page **cluster) {
+    struct thread *owner = victim->owner;
+    size_t cnt = 1;
+
+    cluster[0] = victim;
+    while (cnt < SWAP_CLUSTER_PAGES) {
+        struct page *next = spt_find_page(&owner->spt, victim->va + cnt * PGSIZE);
+        uint64_t *pte;
+        bool ok;
+
+        if (next == NULL || next->operations->type != VM_ANON)
+            break;
+
+        pte = vm_page_pte(next);
+        lock_acquire(&frame_table_lock);
+        ok = next->frame != NULL && next->frame->page == next && vm_frame_evictable(next->frame) && !pte_is_accessed(pte);
+        if (ok)
+            next->frame->pinned = true;
+        lock_release(&frame_table_lock);
+        if (!ok)
+            break;
+        cluster[cnt++] = next;
     }
+    return cnt;
+}
 
+/* Evict one page of OWNER, or of any process if OWNER is NULL, and
+ * return the corresponding frame.
+ * Anonymous victims are evicted together with their virtually adjacent
+ * neighbours into contiguous swap slots; the neighbours' frames go back
+ * to the user pool so that the following faults find them free.  The
+ * owner's spt lock is held throughout, so that the owner can neither
+ * change nor free the pages meanwhile.
+ * Return NULL on error.*/
+static struct frame *vm_evict_frame(struct thread *owner) {
+    struct lock *spt_lock;
+    struct frame *victim = vm_get_victim(owner, &spt_lock);
+    struct page *cluster[SWAP_CLUSTER_PAGES];
+    struct frame *frames[SWAP_CLUSTER_PAGES];
+    size_t cnt;
+    bool ok;
+
+    if (victim == NULL)
+        return NULL;
+    if (victim->shm != NULL)
+        ok = shm_swap_out(victim);
+    else if (!huge_split(victim->page))
+        ok = false;
+    else if (victim->page->operations->type == VM_ANON) {
+        cnt = vm_gather_swap_cluster(victim->page, cluster);
+        for (size_t i = 0; i < cnt; i++)
+            frames[i] = cluster[i]->frame;
+
+        anon_swap_out_cluster(cluster, cnt);
+
+        for (size_t i = 1; i < cnt; i++) {
+            if (cluster[i]->frame != NULL) {
+                unpin_frame(frames[i]);
+                continue;
+            }
+            frames[i]->page = NULL;
+            free_frame(frames[i]);
+        }
+        ok = cluster[0]->frame == NULL;
+    } else
+        ok = swap_out(victim->page);
+
+    if (!ok)
+        unpin_frame(victim);
+    if (spt_lock != NULL)
+        lock_release(spt_lock);
+    if (!ok)
+        return NULL;
+
+    victim->page = NULL;
+    memset(victim->kva, 0, PGSIZE);
+    victim->ref_cnt = 1;
     return victim;
 }
 
+/* Allocates a frame from the user pool without evicting anything.
+ * Returns NULL if the user pool is exhausted.  The frame is returned
+ * pinned; the caller unpins it once its contents are valid and mapped. */
+struct frame *vm_try_get_frame(void) {
+    struct frame *frame;
+    void *kva = palloc_get_page(PAL_USER | PAL_ZERO);
+
+    kswapd_poke();
+    if (kva == NULL)
+        return NULL;
+
+    frame = vm_kva_to_frame(kva);
+    lock_acquire(&frame_table_lock);
+    frame->page = NULL;
+    frame->ref_cnt = 1;
+    frame->pinned = true;
+    lock_release(&frame_table_lock);
+    return frame;
+}
+
 /* palloc() and get frame. If there is no available page, evict the page
  * and return it. This always return valid address. That is, if the user pool
  * memory is full, this function evicts the frame to get the available memory
- * space.*/
+ * space.  A process at its resident-set limit gets one of its own frames
+ * back instead, unless none of them can be evicted. */
 static struct frame *vm_get_frame(void) {
     struct frame *frame = NULL;
 
-    frame = calloc(1, sizeof(struct frame));
-    frame->kva = palloc_get_page(PAL_USER | PAL_ZERO);
-    frame->page = NULL;
-    frame->ref_cnt = 1;
-    if (frame->kva == NULL) {
-        frame = vm_evict_frame();
-        frame->page = NULL;
-        return frame;
+    if (rss_over_limit(thread_current())) {
+        frame = vm_evict_frame(thread_current());
+        if (frame != NULL)
+            rss_note_self_eviction();
+    }
+    if (frame == NULL)
+        frame = vm_try_get_frame();
+    while (frame == NULL) {
+        long long busy = busy_victims;
+
+        direct_reclaims++;
+        frame = vm_evict_frame(NULL);
+        if (frame == NULL && file_writeback_reclaim())
+            frame = vm_try_get_frame();
+        if (frame != NULL || busy == busy_victims)
+            break;
+
+        /* Victims were skipped because their owners are busy with their
+         * spts.  Give up one of our own pages if we have one, otherwise
+         * let the owners finish and try again. */
+        frame = vm_evict_frame(thread_current());
+        if (frame == NULL) {
+            thread_yield();
+            frame = vm_try_get_frame();
+        }
     }
-
-    lock_acquire(&frame_table_lock);
-    list_push_back(&frame_table, &frame->frame_elem);
-    lock_release(&frame_table_lock);
 
     ASSERT(frame != NULL);
     ASSERT(frame->page == NULL);
+    ASSERT(frame->pinned);
     return frame;
 }
 
+/* Evicts one page and returns its frame to the user pool.
+ * Returns false if no page could be evicted. */
+bool vm_reclaim_frame(void) {
+    struct frame *frame = vm_evict_frame(NULL);
+
+    if (frame == NULL)
+        return false;
+    free_frame(frame);
+    return true;
+}
+
 /* Growing the stack. */
 static void vm_stack_growth(void *addr UNUSED) {
     vm_alloc_page(VM_ANON | VM_MARKER_0, pg_round_down(addr), 1);
     vm_claim_page(addr);
 }
 
-/* Handle the fault on write_protected page */
+/* Handle the fault on write_protected page.
+ * The page is copy-on-write if it is shared with other mappings (after
+ * fork or a merge by ksmd) and was writable before sharing. */
 static bool vm_handle_wp(struct page *page UNUSED) {
-    if (page->frame->ref_cnt == 1)
+    struct frame *old_frame = page->frame;
+
+    if (old_frame == NULL || (!page->writable && !page->parent_writable))
         return false;
-    if (page->frame->ref_cnt > 1) {
+    if (!huge_split(page))
+        return false;
+
+    lock_acquire(&frame_table_lock);
+    if (old_frame->ref_cnt == 1) {
+        /* Last user of a formerly shared frame: take it over. */
+        old_frame->page = page;
+        old_frame->ksm = false;
+        lock_release(&frame_table_lock);
+    } else {
+        lock_release(&frame_table_lock);
         struct frame *new_frame = vm_get_frame();
         if (!new_frame)
             return false;
-        memcpy(new_frame->kva, page->frame->kva, PGSIZE);
+        memcpy(new_frame->kva, old_frame->kva, PGSIZE);
         lock_acquire(&frame_table_lock);
-        page->frame->ref_cnt--;
+        old_frame->ref_cnt--;
+        if (old_frame->page == page)
+            old_frame->page = NULL;
+        new_frame->page = page;
+        vm_unpin_frame(new_frame);
         page->frame = new_frame;
-        page->frame->ref_cnt = 1;
         lock_release(&frame_table_lock);
-        pml4_clear_page(thread_current()->pml4, page->va);
+        vm_unmap_page(page);
     }
     page->writable = true;
-    pml4_set_page(thread_current()->pml4, page->va, page->frame->kva, true);
+    vm_map_page(page, page->frame->kva, true);
 
     return true;
 }
 
-/* Return true on success */
-bool vm_try_handle_fault(struct intr_frame *f UNUSED, void *addr UNUSED, bool user UNUSED, bool write UNUSED, bool not_present UNUSED) {
-    struct supplemental_page_table *spt UNUSED = &thread_current()->spt;
+/* Returns the kind of fault that bringing in non-resident PAGE resolves. */
+static enum fault_kind vm_fault_kind(struct page *page) {
+    switch (page->operations->type) {
+    case VM_UNINIT:
+        if (page->uninit.init != lazy_load_segment)
+            return FAULT_ZERO;
+        return VM_TYPE(page->uninit.type) == VM_FILE ? FAULT_FILE : FAULT_EXEC;
+    case VM_FILE:
+        return FAULT_FILE;
+    default:
+        return FAULT_SWAP;
+    }
+}
+
+/* Handles a fault at ADDR and stores its kind in KIND.
+ * Caller holds the spt lock. */
+static bool vm_handle_fault(struct intr_frame *f, void *addr, bool user, bool write, bool not_present, enum fault_kind *kind) {
+    struct supplemental_page_table *spt = &thread_current()->spt;
     struct page *page = spt_find_page(spt, addr);
+    struct load_aux *aux;
     void *rsp = f->rsp;
 
-    if (addr == NULL || is_kernel_vaddr(addr))
-        return false;
-
     if (not_present) {
         rsp = user ? f->rsp : thread_current()->rsp;
         if (USER_STACK > addr && addr >= USER_STACK - (1 << 20) && addr >= rsp - 8) {
             vm_stack_growth(pg_round_down(addr));
+            *kind = FAULT_STACK;
             return true;
         }
         if (!page)
             return false;
         if (write && !page->writable)
             return false;
-        return vm_do_claim_page(page);
-    } else
-        return vm_handle_wp(page);
+        *kind = vm_fault_kind(page);
+        if (huge_fault(page))
+            return true;
 
-    return false;
+        /* Claiming turns a page of an executable into an anonymous one. */
+        aux = vm_file_aux(page);
+        if (!vm_do_claim_page(page))
+            return false;
+        vm_fault_around(page, aux);
+        return true;
+    }
+    *kind = FAULT_COW;
+    return vm_handle_wp(page);
+}
+
+/* Return true on success */
+bool vm_try_handle_fault(struct intr_frame *f UNUSED, void *addr UNUSED, bool user UNUSED, bool write UNUSED, bool not_present UNUSED) {
+    struct supplemental_page_table *spt = &thread_current()->spt;
+    uint64_t start = rdtsc();
+    enum fault_kind kind;
+    bool success;
+
+    if (addr == NULL || is_kernel_vaddr(addr))
+        return false;
+    if (user)
+        loadctl_checkpoint();
+
+    lock_acquire(&spt->lock);
+    success = vm_handle_fault(f, addr, user, write, not_present, &kind);
+    lock_release(&spt->lock);
+    if (success)
+        faultstat_record(kind, rdtsc() - start);
+    return success;
 }
 
 /* Free the page.
@@ -243,32 +541,169 @@ bool vm_claim_page(void *va UNUSED) {
 
 /* Claim the PAGE and set up the mmu. */
 static bool vm_do_claim_page(struct page *page) {
-    struct frame *frame = vm_get_frame();
-    struct thread *current = thread_current();
-    uint64_t pml4 = current->pml4;
+    if (share_claim(page) || shm_claim(page))
+        return true;
+    return vm_map_frame(page, vm_get_frame());
+}
 
+/* Link PAGE with the pinned FRAME, map it and read its contents in.
+ * The frame is unpinned once the contents are in place. */
+static bool vm_map_frame(struct page *page, struct frame *frame) {
     /* Set links */
     frame->page = page;
-    page->frame = frame;
+    vm_set_frame(page, frame);
+    while (!share_register(page) || !shm_register(page)) {
+        /* Another process brought in this page of a shared mapping
+         * or segment meanwhile; map its frame instead, unless it went
+         * away again. */
+        vm_set_frame(page, NULL);
+        if (share_claim(page) || shm_claim(page)) {
+            frame->page = NULL;
+            free_frame(frame);
+            return true;
+        }
+        vm_set_frame(page, frame);
+    }
 
     /* TODO: Insert page table entry to map page's VA to frame's PA. */
-    if (!pml4_set_page(pml4, page->va, frame->kva, page->writable))
+    bool success = vm_map_page(page, frame->kva, page->writable) && swap_in(page, frame->kva);
+    unpin_frame(frame);
+    return success;
+}
+
+/* Returns the load_aux of PAGE if its contents come from a file, either
+ * still lazily loaded, a file-backed page that is not resident, or a
+ * page of an executable whose contents were dropped, which reads its
+ * segment again. */
+static struct load_aux *vm_file_aux(struct page *page) {
+    if (page->operations->type == VM_UNINIT)
+        return page->uninit.init == lazy_load_segment ? page->uninit.aux : NULL;
+    if (page->operations->type == VM_FILE)
+        return page->uninit.aux;
+    if (page->operations->type == VM_ANON && page->frame == NULL && page->slot_no == BITMAP_ERROR
+        && page->anon.zswap == NULL)
+        return page->anon.origin;
+    return NULL;
+}
+
+/* Brings PAGE in ahead of use, from the shared text cache if possible
+ * and otherwise into a free frame; nothing is evicted to make room.
+ * Returns false if no frame was available, the owner is at its
+ * resident-set limit or the page could not be read. */
+bool vm_prefetch_page(struct page *page) {
+    struct frame *frame;
+
+    if (rss_over_limit(page->owner))
         return false;
 
-    return swap_in(page, frame->kva);
+    if (share_claim(page) || shm_claim(page))
+        return true;
+
+    frame = vm_try_get_frame();
+    if (frame == NULL)
+        return false;
+    if (!vm_map_frame(page, frame)) {
+        vm_unmap_page(page);
+        vm_release_frame(page);
+        return false;
+    }
+    return true;
+}
+
+/* Faults in every non-resident page of the current process that lies in
+ * [ADDR, ADDR + LENGTH), in one pass under the spt lock.  Unlike
+ * fault-around this may evict.  Returns false if a page could not be
+ * brought in. */
+bool vm_populate(void *addr, size_t length) {
+    struct supplemental_page_table *spt = &thread_current()->spt;
+    uint8_t *va = pg_round_down(addr);
+    uint8_t *end = (uint8_t *)addr + length;
+    bool success = true;
+
+    lock_acquire(&spt->lock);
+    for (; va < end; va += PGSIZE) {
+        struct page *page = spt_find_page(spt, va);
+
+        if (page == NULL || page->frame != NULL)
+            continue;
+        if (!vm_do_claim_page(page)) {
+            success = false;
+            break;
+        }
+    }
+    lock_release(&spt->lock);
+    return success;
+}
+
+/* Drops the resident and swapped contents of PAGE for MADV_DONTNEED.
+ * Dirty file-backed pages are written back first; anonymous pages read
+ * back from their executable, or as zeroes.  Pages being evicted or
+ * loaded are left alone.  Caller holds the spt lock, which keeps
+ * evictors away from the page meanwhile. */
+void vm_discard_page(struct page *page) {
+    struct frame *frame = page->frame;
+    bool busy = false;
+
+    if (page->operations->type == VM_UNINIT)
+        return;
+
+    if (frame != NULL) {
+        lock_acquire(&frame_table_lock);
+        busy = frame->pinned;
+        lock_release(&frame_table_lock);
+    }
+    if (!busy)
+        destroy(page);
+}
+
+/* Fault-around: after a fault on PAGE that read the file range of AUX,
+ * or NULL if it read no file, map the non-resident neighbours inside
+ * the aligned window that read the same file at matching offsets, so sequential access takes one fault per window.
+ * The window is widened for MADV_SEQUENTIAL and skipped for MADV_RANDOM.
+ * Only free frames are used; nothing is evicted to make room. */
+static void vm_fault_around(struct page *page, struct load_aux *aux) {
+    size_t window = fault_around_bytes;
+    uint8_t *start, *end, *va;
+
+    if (page->advice == MADV_RANDOM)
+        return;
+    if (page->advice == MADV_SEQUENTIAL)
+        window = FAULT_AROUND_MAX;
+    if (aux == NULL || window < 2 * PGSIZE)
+        return;
+
+    start = (uint8_t *)page->va - (uint64_t)page->va % window;
+    end = start + window;
+    for (va = start; va < end && is_user_vaddr(va); va += PGSIZE) {
+        struct page *near = spt_find_page(&page->owner->spt, va);
+        struct load_aux *near_aux;
+
+        if (near == NULL || near == page || near->frame != NULL)
+            continue;
+        near_aux = vm_file_aux(near);
+        if (near_aux == NULL || near_aux->file != aux->file || near_aux->offset - aux->offset != va - (uint8_t *)page->va)
+            continue;
+        if (!vm_prefetch_page(near))
+            return;
+    }
 }
 
 /* Initialize new supplemental page table */
 void supplemental_page_table_init(struct supplemental_page_table *spt UNUSED) {
 
     hash_init(&spt->hash_spt, page_hash, page_less, NULL);
+    lock_init(&spt->lock);
+    spt->dying = false;
+    heap_init(spt);
 }
 
 /* Copy supplemental page table from src to dst */
 bool supplemental_page_table_copy(struct supplemental_page_table *dst UNUSED, struct supplemental_page_table *src UNUSED) {
 
     struct hash_iterator i;
+    bool success = false;
 
+    lock_acquire(&src->lock);
     hash_first(&i, &src->hash_spt);
     while (hash_next(&i)) {
         struct page *parent_page = hash_entry(hash_cur(&i), struct page, hash_elem);
@@ -280,19 +715,36 @@ bool supplemental_page_table_copy(struct supplemental_page_table *dst UNUSED, st
         struct load_aux *aux = parent_page->uninit.aux;
         bool writable = parent_page->writable;
 
+        /* Shared file mappings stay shared: the child finds the
+         * parent's frames in the share index on its first access. */
+        if (page_type == VM_FILE && vm_file_aux(parent_page) != NULL && vm_file_aux(parent_page)->shared) {
+            if (!vm_alloc_page_with_initializer(VM_FILE, upage, writable, lazy_load_segment, vm_file_aux(parent_page)))
+                goto out;
+            spt_find_page(dst, upage)->advice = parent_page->advice;
+            continue;
+        }
+        /* So do segment attachments, which heap_copy() carries over. */
+        if (parent_page->operations->type == VM_SHM) {
+            if (!shm_copy_page(parent_page))
+                goto out;
+            spt_find_page(dst, upage)->advice = parent_page->advice;
+            continue;
+        }
         if (parent_page->operations->type == VM_UNINIT) {
-            vm_alloc_page_with_initializer(VM_ANON, upage, writable, init, aux);
+            if (vm_alloc_page_with_initializer(VM_ANON, upage, writable, init, aux))
+                spt_find_page(dst, upage)->advice = parent_page->advice;
             continue;
         }
         if (parent_page->operations->type == VM_FILE) {
             // struct load_aux *file_aux = malloc(sizeof(struct load_aux));
             // file_aux=aux;
             if (!vm_alloc_page_with_initializer(VM_FILE, upage, writable, NULL, aux))
-                return false;
+                goto out;
             child_page = spt_find_page(dst, upage);
+            child_page->advice = parent_page->advice;
 
             child_page->operations = parent_page->operations;
-            child_page->frame = parent_page->frame;
+            vm_set_frame(child_page, parent_page->frame);
             child_page->writable = false;
             child_page->parent_writable = parent_page->writable;
 
@@ -300,17 +752,20 @@ bool supplemental_page_table_copy(struct supplemental_page_table *dst UNUSED, st
             parent_page->frame->ref_cnt++;
             lock_release(&frame_table_lock);
 
-            pml4_set_page(thread_current()->pml4, child_page->va, child_page->frame->kva, child_page->writable);
+            vm_map_page(child_page, child_page->frame->kva, child_page->writable);
             continue;
         }
 
         if (!vm_alloc_page(page_type, upage, writable))
-            return false;
+            goto out;
 
         child_page = spt_find_page(dst, upage);
+        child_page->advice = parent_page->advice;
+        child_page->anon.zswap = NULL;
+        child_page->anon.origin = parent_page->anon.origin;
 
         child_page->operations = parent_page->operations;
-        child_page->frame = parent_page->frame;
+        vm_set_frame(child_page, parent_page->frame);
         child_page->writable = false;
         child_page->parent_writable = parent_page->writable;
 
@@ -318,14 +773,32 @@ bool supplemental_page_table_copy(struct supplemental_page_table *dst UNUSED, st
         parent_page->frame->ref_cnt++;
         lock_release(&frame_table_lock);
 
-        pml4_set_page(thread_current()->pml4, child_page->va, child_page->frame->kva, child_page->writable);
+        vm_map_page(child_page, child_page->frame->kva, child_page->writable);
     }
-    return true;
+    success = heap_copy(dst, src);
+out:
+    lock_release(&src->lock);
+    return success;
 }
 
-/* Free the resource hold by the supplemental page table */
+/* Free the resource hold by the supplemental page table.
+ * The page table goes away as a whole afterwards (see process_cleanup()),
+ * so the pages are not unmapped one by one.  Dirty file-backed pages
+ * are queued for writebackd and swap slots released in one batch. */
 void supplemental_page_table_kill(struct supplemental_page_table *spt UNUSED) {
+    struct mmu_gather tlb;
+
+    madvise_cancel(thread_current());
+    lock_acquire(&spt->lock);
+    spt->dying = true;
+    file_writeback_exit(spt);
+    anon_swap_release(spt);
+    mmu_gather_begin(&tlb, thread_current()->pml4);
     hash_clear(&spt->hash_spt, destructor);
+    mmu_gather_end(&tlb);
+    heap_kill(spt);
+    spt->dying = false;
+    lock_release(&spt->lock);
 }
 
 void destructor(struct hash_elem *e, void *aux) {
@@ -345,18 +818,119 @@ bool page_less(const struct hash_elem *a_, const struct hash_elem *b_, void *aux
 
     return a->va < b->va;
 }
+/* Prints virtual memory statistics. */
+void vm_print_stats(void) {
+    zswap_print_stats();
+    ksm_print_stats();
+    share_print_stats();
+    file_print_stats();
+    faultstat_print_stats();
+    kswapd_print_stats();
+    rss_print_stats();
+    loadctl_print_stats();
+    huge_print_stats();
+    printf("frames: %zu of %zu free, %lld direct reclaims, %lld busy victims skipped\n",
+           palloc_user_free_cnt(), frame_table_size, direct_reclaims, busy_victims);
+}
+
+/* Drops a reference to FRAME and returns its page to the user pool
+ * once it has no more users.  Caller must hold frame_table_lock. */
+void vm_put_frame(struct frame *frame) {
+    if (--frame->ref_cnt > 0)
+        return;
+
+    ksm_forget(frame);
+    share_forget(frame);
+    frame->page = NULL;
+    vm_unpin_frame(frame);
+    frame->ksm = false;
+    frame->huge = false;
+    frame->shm = NULL;
+    mmu_gather_free_page(frame->kva);
+}
+
 void free_frame(struct frame *frame) {
     lock_acquire(&frame_table_lock);
+    vm_put_frame(frame);
+    lock_release(&frame_table_lock);
+}
+
+/* Unpins FRAME and wakes up the threads waiting for a frame to be
+ * unpinned.  Caller must hold frame_table_lock. */
+void vm_unpin_frame(struct frame *frame) {
+    frame->pinned = false;
+    cond_broadcast(&frame_unpinned, &frame_table_lock);
+}
+
+void unpin_frame(struct frame *frame) {
+    lock_acquire(&frame_table_lock);
+    vm_unpin_frame(frame);
+    lock_release(&frame_table_lock);
+}
 
-    if (frame->ref_cnt > 1) {
-        frame->ref_cnt--;
-        lock_release(&frame_table_lock);
-        return;
+/* Waits until some frame is unpinned.  Caller must hold
+ * frame_table_lock, which is released meanwhile, and check again for
+ * whatever it was waiting for. */
+void vm_wait_unpinned(void) {
+    cond_wait(&frame_unpinned, &frame_table_lock);
+}
+
+/* Points PAGE at FRAME, or at no frame if FRAME is NULL, and charges
+ * or uncharges the owner's resident set. */
+void vm_set_frame(struct page *page, struct frame *frame) {
+    if (page->frame == NULL && frame != NULL)
+        rss_charge(page->owner, 1);
+    else if (page->frame != NULL && frame == NULL)
+        rss_charge(page->owner, -1);
+    page->frame = frame;
+}
+
+/* Maps PAGE to the frame at KVA in its owner's page table and keeps
+ * the page table entry in PAGE, so that later accesses need no walk.
+ * The entry stays cached only while it is present: a page table is
+ * freed only once none of its entries are, so the pointer never
+ * outlives its page table. */
+bool vm_map_page(struct page *page, void *kva, bool writable) {
+    page->pte = pml4_map_page(page->owner->pml4, page->va, kva, writable);
+    return page->pte != NULL;
+}
+
+/* Unmaps PAGE from its owner's page table, unless the page table is
+ * about to go as a whole. */
+void vm_unmap_page(struct page *page) {
+    if (!page->owner->spt.dying) {
+        if (page->pte != NULL)
+            pte_clear(page->owner->pml4, page->pte, page->va);
+        else
+            pml4_clear_page(page->owner->pml4, page->va);
     }
+    page->pte = NULL;
+}
+
+/* Returns the page table entry that maps PAGE: the cached one, or for
+ * pages mapped otherwise (by a 2 MB entry, or not at all) the result of
+ * a walk, which may be a null pointer. */
+uint64_t *vm_page_pte(struct page *page) {
+    if (page->pte != NULL)
+        return page->pte;
+    return pml4e_walk(page->owner->pml4, (uint64_t)page->va, false);
+}
 
-    list_remove(&frame->frame_elem);
-    palloc_free_page(frame->kva);
-    free(frame);
+/* Drops PAGE's reference to its frame, freeing the frame if PAGE was
+ * its last user.  A frame pinned by someone else, who is still reading
+ * or writing it, is waited for first; an eviction may have taken the
+ * frame from PAGE by then. */
+void vm_release_frame(struct page *page) {
+    struct frame *frame;
 
+    lock_acquire(&frame_table_lock);
+    while ((frame = page->frame) != NULL && frame->pinned)
+        vm_wait_unpinned();
+    if (frame != NULL) {
+        if (frame->page == page)
+            frame->page = NULL;
+        vm_set_frame(page, NULL);
+        vm_put_frame(frame);
+    }
     lock_release(&frame_table_lock);
 }
@@ -0,0 +1,290 @@
+/* zswap.c: Compressed in-memory cache for evicted anonymous pages.
+ *
+ * Before an anonymous page goes to the swap disk, it is compressed with
+ * a small LZ77 compressor (LZ4-like sequence format) and kept in kernel
+ * memory.  Pages that do not compress into the largest malloc() block,
+ * or that do not fit into the pool, fall back to the swap disk. */
+
+#include "vm/zswap.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+#include <debug.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/* Shortest match worth encoding. */
+#define LZ_MIN_MATCH 4
+/* Size of the match finder hash table, in bits. */
+#define LZ_HASH_BITS 12
+/* Largest malloc() block size class.  Larger requests get whole pages
+ * of their own. */
+#define ZSWAP_MAX_BLOCK 1024
+/* Compressed pages whose entry does not fit into the largest block are
+ * treated as incompressible: they would cost a whole page anyway. */
+#define ZSWAP_MAX_LEN (ZSWAP_MAX_BLOCK - sizeof(struct zswap_entry))
+
+/* Default pool limit, in pages. */
+#define ZSWAP_DEFAULT_POOL_PAGES 128
+
+struct zswap_entry {
+    size_t len;      /* Compressed length in bytes. */
+    uint8_t data[];  /* Compressed page. */
+};
+
+size_t zswap_pool_limit = ZSWAP_DEFAULT_POOL_PAGES;
+
+static struct lock zswap_lock;
+static size_t pool_bytes;               /* Bytes of malloc() blocks held. */
+static uint16_t lz_table[1 << LZ_HASH_BITS];
+static uint8_t lz_buf[ZSWAP_MAX_LEN];   /* Compression scratch buffer. */
+
+/* Statistics. */
+static long long store_cnt;        /* Pages stored in the pool. */
+static long long reject_incomp;    /* Pages rejected as incompressible. */
+static long long reject_full;      /* Pages rejected because pool was full. */
+static long long load_hits;        /* Swap-ins served from the pool. */
+static long long load_misses;      /* Swap-ins that went to the disk. */
+static long long bytes_in;         /* Uncompressed bytes stored. */
+static long long bytes_out;        /* Compressed bytes stored. */
+static size_t pool_peak;           /* Largest pool size seen. */
+
+void zswap_init(void) {
+    lock_init(&zswap_lock);
+}
+
+static inline uint32_t
+lz_read32(const uint8_t *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline unsigned
+lz_hash(uint32_t seq) {
+    return (seq * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+/* Appends LEN extra length bytes for a length field that saturated. */
+static void
+lz_put_length(uint8_t **op, size_t len) {
+    while (len >= 255) {
+        *(*op)++ = 255;
+        len -= 255;
+    }
+    *(*op)++ = len;
+}
+
+/* Emits one sequence: LIT_LEN literals at LIT followed by a match of
+ * MATCH_LEN bytes at distance OFFSET.  A MATCH_LEN of 0 emits the final
+ * literal-only sequence.  Returns false if OP_END would be exceeded. */
+static bool
+lz_emit(uint8_t **op, uint8_t *op_end, const uint8_t *lit, size_t lit_len,
+        size_t offset, size_t match_len) {
+    size_t need = 1 + lit_len + lit_len / 255 + 1;
+    uint8_t *token;
+
+    if (match_len)
+        need += 2 + (match_len - LZ_MIN_MATCH) / 255 + 1;
+    if ((size_t)(op_end - *op) < need)
+        return false;
+
+    token = (*op)++;
+    *token = (lit_len >= 15 ? 15 : lit_len) << 4;
+    if (lit_len >= 15)
+        lz_put_length(op, lit_len - 15);
+    memcpy(*op, lit, lit_len);
+    *op += lit_len;
+
+    if (match_len) {
+        size_t m = match_len - LZ_MIN_MATCH;
+
+        *(*op)++ = offset & 0xff;
+        *(*op)++ = offset >> 8;
+        *token |= m >= 15 ? 15 : m;
+        if (m >= 15)
+            lz_put_length(op, m - 15);
+    }
+    return true;
+}
+
+/* Compresses LEN bytes at SRC into DST, which has room for CAP bytes.
+ * Returns the compressed length, or 0 if it does not fit. */
+static size_t
+lz_compress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap) {
+    const uint8_t *ip = src, *anchor = src, *end = src + len;
+    uint8_t *op = dst, *op_end = dst + cap;
+
+    memset(lz_table, 0, sizeof lz_table);
+    while (ip + LZ_MIN_MATCH <= end) {
+        uint32_t seq = lz_read32(ip);
+        unsigned h = lz_hash(seq);
+        const uint8_t *ref = src + lz_table[h];
+
+        lz_table[h] = ip - src;
+        if (ref < ip && ip - ref <= 0xffff && lz_read32(ref) == seq) {
+            size_t match_len = LZ_MIN_MATCH;
+
+            while (ip + match_len < end && ref[match_len] == ip[match_len])
+                match_len++;
+            if (!lz_emit(&op, op_end, anchor, ip - anchor, ip - ref, match_len))
+                return 0;
+            ip += match_len;
+            anchor = ip;
+        } else
+            ip++;
+    }
+    if (!lz_emit(&op, op_end, anchor, end - anchor, 0, 0))
+        return 0;
+    return op - dst;
+}
+
+/* Reads an extended length field starting with NIBBLE. */
+static size_t
+lz_get_length(const uint8_t **ip, const uint8_t *end, size_t nibble) {
+    size_t len = nibble;
+    uint8_t b;
+
+    if (nibble != 15)
+        return len;
+    do {
+        b = *(*ip)++;
+        len += b;
+    } while (b == 255 && *ip < end);
+    return len;
+}
+
+/* Decompresses LEN bytes at SRC into exactly CAP bytes at DST.
+ * Returns false if the input is malformed. */
+static bool
+lz_decompress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap) {
+    const uint8_t *ip = src, *end = src + len;
+    uint8_t *op = dst, *op_end = dst + cap;
+
+    while (ip < end) {
+        uint8_t token = *ip++;
+        size_t lit_len = lz_get_length(&ip, end, token >> 4);
+        size_t offset, match_len;
+        const uint8_t *ref;
+
+        if (lit_len > (size_t)(end - ip) || lit_len > (size_t)(op_end - op))
+            return false;
+        memcpy(op, ip, lit_len);
+        op += lit_len;
+        ip += lit_len;
+        if (ip >= end)
+            break;
+
+        if (end - ip < 2)
+            return false;
+        offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        match_len = lz_get_length(&ip, end, token & 15) + LZ_MIN_MATCH;
+        if (offset == 0 || offset > (size_t)(op - dst) || match_len > (size_t)(op_end - op))
+            return false;
+
+        /* Byte by byte: the match may overlap the output. */
+        for (ref = op - offset; match_len > 0; match_len--)
+            *op++ = *ref++;
+    }
+    return op == op_end;
+}
+
+/* Returns the size of the malloc() block that holds an entry with LEN
+ * bytes of compressed data. */
+static size_t
+entry_size(size_t len) {
+    size_t size = 16;
+
+    while (size < sizeof(struct zswap_entry) + len)
+        size *= 2;
+    return size;
+}
+
+/* Compresses the page at KVA into the pool.  Returns the pool entry, or
+ * NULL if the page is incompressible or the pool is full, in which case
+ * the caller writes the page to the swap disk. */
+struct zswap_entry *
+zswap_store(const void *kva) {
+    struct zswap_entry *entry = NULL;
+    size_t len;
+
+    if (zswap_pool_limit == 0)
+        return NULL;
+
+    lock_acquire(&zswap_lock);
+    len = lz_compress(kva, PGSIZE, lz_buf, sizeof lz_buf);
+    if (len == 0) {
+        reject_incomp++;
+        goto done;
+    }
+    if (pool_bytes + entry_size(len) > zswap_pool_limit * PGSIZE) {
+        reject_full++;
+        goto done;
+    }
+
+    entry = malloc(sizeof *entry + len);
+    if (entry == NULL) {
+        reject_full++;
+        goto done;
+    }
+    entry->len = len;
+    memcpy(entry->data, lz_buf, len);
+
+    pool_bytes += entry_size(len);
+    if (pool_bytes > pool_peak)
+        pool_peak = pool_bytes;
+    store_cnt++;
+    bytes_in += PGSIZE;
+    bytes_out += len;
+done:
+    lock_release(&zswap_lock);
+    return entry;
+}
+
+/* Decompresses ENTRY into the page at KVA and releases it.
+ * ENTRY may be NULL, meaning the page is not in the pool; returns
+ * false in that case so the caller reads the swap disk instead. */
+bool zswap_load(struct zswap_entry *entry, void *kva) {
+    bool ok;
+
+    if (entry == NULL) {
+        lock_acquire(&zswap_lock);
+        load_misses++;
+        lock_release(&zswap_lock);
+        return false;
+    }
+
+    ok = lz_decompress(entry->data, entry->len, kva, PGSIZE);
+    if (!ok)
+        PANIC("zswap: corrupted compressed page");
+
+    lock_acquire(&zswap_lock);
+    load_hits++;
+    lock_release(&zswap_lock);
+    zswap_free(entry);
+    return true;
+}
+
+/* Drops ENTRY from the pool without decompressing it. */
+void zswap_free(struct zswap_entry *entry) {
+    if (entry == NULL)
+        return;
+    lock_acquire(&zswap_lock);
+    pool_bytes -= entry_size(entry->len);
+    lock_release(&zswap_lock);
+    free(entry);
+}
+
+/* Prints compressed swap statistics. */
+void zswap_print_stats(void) {
+    long long loads = load_hits + load_misses;
+    long long ratio = bytes_out ? bytes_in * 100 / bytes_out : 0;
+
+    printf("zswap: %lld stores, %lld incompressible, %lld pool full\n",
+           store_cnt, reject_incomp, reject_full);
+    printf("zswap: ratio %lld.%02lldx, pool %zu/%zu kB (peak %zu kB), "
+           "hit rate %lld/%lld\n",
+           ratio / 100, ratio % 100, pool_bytes / 1024,
+           zswap_pool_limit * PGSIZE / 1024, pool_peak / 1024,
+           load_hits, loads);
+}